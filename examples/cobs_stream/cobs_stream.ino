@@ -0,0 +1,36 @@
+/*
+  Consisten Overhead Byte Stuffing (COBS)
+
+  This example receives COBS encoded frames on the serial port and sends 
+  each frame back (again COBS encoded) with all bytes incremented by one.
+
+  Bytes are read from and written to the serial port in bulk, not byte
+  by byte. Received frames are decoded in-place in the receive buffer.
+    
+  This example code is in the public domain.
+*/
+
+#include "cobs.h"
+#include "cobs_stream.h"
+
+// maximum length of a decoded frame
+const size_t MAX_FRAME_SIZE = 64;
+
+uint8_t rx_buffer[MAX_FRAME_SIZE];
+COBSStreamReader<Stream> reader(Serial, rx_buffer, sizeof(rx_buffer));
+
+void setup() {
+    Serial.begin(115200);
+    while (!Serial);
+}
+
+void loop() {
+    size_t len = reader.read();
+    if (len > 0) {
+        uint8_t reply[MAX_FRAME_SIZE];
+        for (size_t i=0; i<len; i++) {
+            reply[i] = reader.frame()[i] + 1;
+        }
+        writeCOBS(Serial, reply, len);
+    }
+}
@@ -8,6 +8,8 @@
 */
 
 #include "cobs.h"
+#include "cobs_escape.h"
+#include "cobs_aead.h"
 
 // helper function to print byte-wise comparison of two buffers
 void print_byte_comparison(const uint8_t *buf1, const uint8_t *buf2, size_t len) {
@@ -23,6 +25,56 @@ void print_byte_comparison(const uint8_t *buf1, const uint8_t *buf2, size_t len)
     } 
 }
 
+// transformations for testing encodeCOBS_transform() and decodeCOBS_transform():
+// XOR with a running counter, checksum over the plain bytes as trailer
+struct TestTransformContext {
+    uint8_t counter;
+    uint8_t checksum;
+};
+
+void test_encrypt(uint8_t *buf, size_t len, void *context) {
+    TestTransformContext *ctx = static_cast<TestTransformContext *>(context);
+    for (size_t i=0; i<len; i++) {
+        ctx->checksum += buf[i];
+        buf[i] ^= ctx->counter++;
+    }
+}
+
+void test_decrypt(uint8_t *buf, size_t len, void *context) {
+    TestTransformContext *ctx = static_cast<TestTransformContext *>(context);
+    for (size_t i=0; i<len; i++) {
+        buf[i] ^= ctx->counter++;
+        ctx->checksum += buf[i];
+    }
+}
+
+void test_increment(uint8_t *buf, size_t len, void *) {
+    for (size_t i=0; i<len; i++) buf[i]++;
+}
+
+void test_decrement(uint8_t *buf, size_t len, void *) {
+    for (size_t i=0; i<len; i++) buf[i]--;
+}
+
+// message and its encoding in flash memory for testing encodeCOBS_P() and decodeCOBS_P()
+const uint8_t FLASH_MESSAGE[] PROGMEM = {0x45, 0x00, 0x00, 0x2C, 0x4C, 0x79, 0x00, 0x00, 0x40, 0x06, 0x4F, 0x37};
+const uint8_t FLASH_ENCODED[] PROGMEM = {0x02, 0x45, 0x01, 0x04, 0x2C, 0x4C, 0x79, 0x01, 0x05, 0x40, 0x06, 0x4F, 0x37, 0x00};
+
+// message for testing encodeCOBS_struct(), without padding bytes
+struct TestMessage {
+    uint8_t  magic[2]; // never zero
+    uint8_t  version;  // never zero
+    uint8_t  type;     // never zero
+    uint16_t value;
+    uint8_t  payload[4];
+};
+
+const COBSNonZeroSpan TEST_MESSAGE_SPANS[] = {
+    COBS_NONZERO_FIELD(TestMessage, magic),
+    COBS_NONZERO_FIELD(TestMessage, version),
+    COBS_NONZERO_FIELD(TestMessage, type)
+};
+
 // helper function to test the functions encodeCOBS(), decodeCOBS() and decodeCOBS_inplace() from cobs.h
 void run_COBS_test(uint8_t *plain, size_t plain_length, uint8_t *encoded, size_t encoded_length, bool with_trailing_zero=true) {
     const size_t result_maxlength = getCOBSBufferSize(plain_length, with_trailing_zero);
@@ -88,6 +140,151 @@ void run_COBS_test(uint8_t *plain, size_t plain_length, uint8_t *encoded, size_t
         print_byte_comparison(encoded_copy, plain, len);
         Serial.println();
     }
+
+    // calculate COBS encoding from a bitmap of the zero positions
+    uint8_t bitmap[plain_length / 8 + 1];
+    memset(bitmap, 0x00, sizeof(bitmap));
+    for (size_t i=0; i<plain_length; i++) {
+        if (plain[i] == 0x00) bitmap[i / 8] |= (1 << (i % 8));
+    }
+    len = encodeCOBS_zerobitmap(plain, plain_length, bitmap, resultbuffer, sizeof(resultbuffer), with_trailing_zero);
+    Serial.print(F("encoding from zero bitmap:   "));
+    if ((encoded_length == len) && (memcmp(encoded, resultbuffer, len) == 0)) {
+        Serial.println(F("OK"));
+    }
+    else {
+        Serial.println(F("failed!"));
+        Serial.println(F("calculated-expected: "));
+        print_byte_comparison(resultbuffer, encoded, len);
+        Serial.println();
+    }
+
+    // calculate COBS encoding of input with COBSEncoder, feed input in small chunks
+    const size_t CHUNK_SIZE = 7;
+    COBSEncoder encoder;
+    size_t pos = 0;
+    len = 0;
+    while (pos < plain_length) {
+        size_t chunk = (plain_length - pos < CHUNK_SIZE) ? plain_length - pos : CHUNK_SIZE;
+        size_t written;
+        pos += encoder.encode(plain + pos, chunk, resultbuffer + len, sizeof(resultbuffer) - len, &written);
+        len += written;
+    }
+    len += encoder.finish(resultbuffer + len, sizeof(resultbuffer) - len, with_trailing_zero);
+    Serial.print(F("encoding in chunks:          "));
+    if ((encoded_length == len) && (memcmp(encoded, resultbuffer, len) == 0)) {
+        Serial.println(F("OK"));
+    }
+    else {
+        Serial.println(F("failed!"));
+        Serial.print(F("length of calculated result: "));
+        Serial.println(len, DEC);
+        Serial.print(F("length of expected result:   "));
+        Serial.println(encoded_length, DEC);
+        Serial.println(F("calculated-expected: "));
+        print_byte_comparison(resultbuffer, encoded, len);
+        Serial.println();
+    }
+
+    // calculate COBS decoding of output with COBSDecoder, feed input in small chunks
+    COBSDecoder decoder;
+    pos = 0;
+    len = 0;
+    while (pos < encoded_length && !decoder.frameComplete()) {
+        size_t chunk = (encoded_length - pos < CHUNK_SIZE) ? encoded_length - pos : CHUNK_SIZE;
+        size_t written;
+        pos += decoder.decode(encoded + pos, chunk, resultbuffer + len, sizeof(resultbuffer) - len, &written);
+        len += written;
+    }
+    Serial.print(F("decoding in chunks:          "));
+    if ((plain_length == len) && (memcmp(plain, resultbuffer, len) == 0) && (pos == encoded_length)) {
+        Serial.println(F("OK"));
+    }
+    else {
+        Serial.println(F("failed!"));
+        Serial.print(F("length of calculated result: "));
+        Serial.println(len, DEC);
+        Serial.print(F("length of expected result:   "));
+        Serial.println(plain_length, DEC);
+        Serial.println(F("calculated-expected: "));
+        print_byte_comparison(resultbuffer, plain, len);
+        Serial.println();
+    }
+
+    // decode in small chunks again, hand over the decoder state to a new decoder after each chunk
+    uint8_t state[COBSDecoder::STATE_SIZE];
+    decoder.reset();
+    decoder.saveState(state, sizeof(state));
+    pos = 0;
+    len = 0;
+    bool complete = false;
+    while (pos < encoded_length && !complete) {
+        COBSDecoder next_decoder;
+        next_decoder.restoreState(state, sizeof(state));
+        size_t chunk = (encoded_length - pos < CHUNK_SIZE) ? encoded_length - pos : CHUNK_SIZE;
+        size_t written;
+        pos += next_decoder.decode(encoded + pos, chunk, resultbuffer + len, sizeof(resultbuffer) - len, &written);
+        len += written;
+        complete = next_decoder.frameComplete();
+        next_decoder.saveState(state, sizeof(state));
+    }
+    Serial.print(F("decoding with state handover:"));
+    if ((plain_length == len) && (memcmp(plain, resultbuffer, len) == 0) && (pos == encoded_length)) {
+        Serial.println(F(" OK"));
+    }
+    else {
+        Serial.println(F(" failed!"));
+    }
+
+    // transform and encode, decode and transform back, check trailer
+    uint8_t transformbuffer[getCOBSBufferSize(plain_length + 1, with_trailing_zero)];
+    TestTransformContext ctx = {0x5A, 0x00};
+    len = encodeCOBS_transform(plain, plain_length, transformbuffer, sizeof(transformbuffer),
+                               test_encrypt, &ctx, &ctx.checksum, 1, with_trailing_zero);
+    const uint8_t checksum = ctx.checksum;
+    ctx.counter = 0x5A;
+    ctx.checksum = 0x00;
+    len = decodeCOBS_transform(transformbuffer, len, transformbuffer, sizeof(transformbuffer),
+                               test_decrypt, &ctx, 1);
+    Serial.print(F("round trip with transform:   "));
+    if ((plain_length + 1 == len) && (memcmp(plain, transformbuffer, plain_length) == 0)
+        && (transformbuffer[plain_length] == checksum) && (ctx.checksum == checksum)) {
+        Serial.println(F("OK"));
+    }
+    else {
+        Serial.println(F("failed!"));
+        Serial.print(F("length of calculated result: "));
+        Serial.println(len, DEC);
+        Serial.print(F("length of expected result:   "));
+        Serial.println(plain_length + 1, DEC);
+        Serial.println(F("calculated-expected: "));
+        print_byte_comparison(transformbuffer, plain, plain_length);
+        Serial.println();
+    }
+
+    // run through a pipeline of two stages and back
+    ctx.counter = 0x5A;
+    const COBSStage stages[] = {
+        {test_increment, test_decrement, NULL},
+        {test_encrypt, test_decrypt, &ctx}
+    };
+    len = encodeCOBS_pipeline(plain, plain_length, transformbuffer, sizeof(transformbuffer), stages, 2, with_trailing_zero);
+    ctx.counter = 0x5A;
+    len = decodeCOBS_pipeline(transformbuffer, len, transformbuffer, sizeof(transformbuffer), stages, 2);
+    Serial.print(F("round trip with pipeline:    "));
+    if ((plain_length == len) && (memcmp(plain, transformbuffer, len) == 0)) {
+        Serial.println(F("OK"));
+    }
+    else {
+        Serial.println(F("failed!"));
+        Serial.print(F("length of calculated result: "));
+        Serial.println(len, DEC);
+        Serial.print(F("length of expected result:   "));
+        Serial.println(plain_length, DEC);
+        Serial.println(F("calculated-expected: "));
+        print_byte_comparison(transformbuffer, plain, len);
+        Serial.println();
+    }
     Serial.println();
     return;
 }
@@ -253,6 +450,228 @@ void setup() {
             run_COBS_test(input, sizeof(input), output, sizeof(output)-i, with_trailing_zero);
         }
     }
+    // encode and decode directly from flash memory
+    {
+        uint8_t message[sizeof(FLASH_MESSAGE)];
+        uint8_t encoded[sizeof(FLASH_ENCODED)];
+        uint8_t result[sizeof(FLASH_ENCODED)];
+        memcpy_P(message, FLASH_MESSAGE, sizeof(message));
+        memcpy_P(encoded, FLASH_ENCODED, sizeof(encoded));
+        size_t len = encodeCOBS_P(FLASH_MESSAGE, sizeof(FLASH_MESSAGE), result, sizeof(result));
+        bool ok = (len == sizeof(encoded)) && (memcmp(result, encoded, len) == 0);
+        len = decodeCOBS_P(FLASH_ENCODED, sizeof(FLASH_ENCODED), result, sizeof(result));
+        ok = ok && (len == sizeof(message)) && (memcmp(result, message, len) == 0);
+        Serial.print(F("encoding/decoding PROGMEM:   "));
+        if (ok) {
+            Serial.println(F("OK"));
+        }
+        else {
+            Serial.println(F("failed!"));
+        }
+    }
+    // COBS/R, switched on by the handshake of COBSNegotiator
+    {
+        uint8_t input[] =    {0x11, 0x22, 0x00, 0x33};
+        uint8_t expected[] = {0x03, 0x11, 0x22, 0x33, 0x00};
+        uint8_t hello[COBS_HELLO_BUFFER_SIZE];
+        uint8_t frame[COBS_HELLO_BUFFER_SIZE];
+        uint8_t result[getCOBSBufferSize(sizeof(input))];
+        COBSNegotiator local;
+        COBSNegotiator old_peer(0);
+        COBSNegotiator new_peer;
+        // old peer: stay with plain COBS
+        size_t len = local.hello(hello, sizeof(hello));
+        len = old_peer.decode(hello, len, frame, sizeof(frame));
+        bool ok = old_peer.receive(frame, len) && old_peer.replyPending();
+        len = old_peer.hello(hello, sizeof(hello), true);
+        len = local.decode(hello, len, frame, sizeof(frame));
+        ok = ok && local.receive(frame, len) && !local.replyPending() && (local.features() == 0);
+        ok = ok && (local.encode(input, sizeof(input), result, sizeof(result)) == sizeof(expected) + 1);
+        // new peer: switch to COBS/R
+        len = new_peer.hello(hello, sizeof(hello));
+        len = local.decode(hello, len, frame, sizeof(frame));
+        ok = ok && local.receive(frame, len) && (local.features() == COBS_FEATURE_COBSR);
+        len = local.encode(input, sizeof(input), result, sizeof(result));
+        ok = ok && (len == sizeof(expected)) && (memcmp(result, expected, len) == 0);
+        len = new_peer.decode(result, len, result, sizeof(result));
+        ok = ok && (len == sizeof(input)) && (memcmp(result, input, len) == 0);
+        Serial.print(F("negotiating COBS/R:          "));
+        if (ok) {
+            Serial.println(F("OK"));
+        }
+        else {
+            Serial.println(F("failed!"));
+        }
+    }
+    // SLIP and HDLC-like byte stuffing, encoded and decoded in-place
+    {
+        uint8_t input[] =         {0x01, 0xC0, 0xDB, 0x7E, 0x7D, 0x02};
+        uint8_t expected_slip[] = {0x01, 0xDB, 0xDC, 0xDB, 0xDD, 0x7E, 0x7D, 0x02, 0xC0};
+        uint8_t expected_hdlc[] = {0x01, 0xC0, 0xDB, 0x7D, 0x5E, 0x7D, 0x5D, 0x02, 0x7E};
+        uint8_t result[getSLIPBufferSize(sizeof(input))];
+        size_t len = encodeSLIP(input, sizeof(input), result, sizeof(result));
+        bool ok = (len == sizeof(expected_slip)) && (memcmp(result, expected_slip, len) == 0);
+        len = decodeSLIP(result, len, result, len);
+        ok = ok && (len == sizeof(input)) && (memcmp(result, input, len) == 0);
+        len = encodeHDLC(input, sizeof(input), result, sizeof(result));
+        ok = ok && (len == sizeof(expected_hdlc)) && (memcmp(result, expected_hdlc, len) == 0);
+        len = decodeHDLC(result, len, result, len);
+        ok = ok && (len == sizeof(input)) && (memcmp(result, input, len) == 0);
+        // invalid escape sequence
+        uint8_t invalid[] = {0x01, 0xDB, 0x02, 0xC0};
+        ok = ok && (decodeSLIP(invalid, sizeof(invalid), result, sizeof(result)) == 0);
+        // HDLC peers may escape control characters, e.g. 0x11 (XON) -> 0x7D 0x31
+        uint8_t escaped_control[] = {0x01, 0x7D, 0x31, 0x7D, 0x20, 0x02, 0x7E};
+        const uint8_t expected_control[] = {0x01, 0x11, 0x00, 0x02};
+        len = decodeHDLC(escaped_control, sizeof(escaped_control), result, sizeof(result));
+        ok = ok && (len == sizeof(expected_control)) && (memcmp(result, expected_control, len) == 0);
+        // escape byte right before the flag (abort sequence)
+        uint8_t aborted[] = {0x01, 0x7D, 0x7E};
+        ok = ok && (decodeHDLC(aborted, sizeof(aborted), result, sizeof(result)) == 0);
+        Serial.print(F("encoding/decoding SLIP/HDLC: "));
+        if (ok) {
+            Serial.println(F("OK"));
+        }
+        else {
+            Serial.println(F("failed!"));
+        }
+    }
+    // encode a struct with known non-zero fields, compare with encodeCOBS()
+    {
+        TestMessage message = {{0xC0, 0xB5}, 1, 3, 0x0100, {0x00, 0x11, 0x00, 0x22}};
+        uint8_t expected[getCOBSBufferSize(sizeof(message))];
+        uint8_t result[getCOBSBufferSize(sizeof(message))];
+        size_t expected_len = encodeCOBS(reinterpret_cast<const uint8_t *>(&message), sizeof(message), expected, sizeof(expected));
+        size_t len = encodeCOBS_struct(message, TEST_MESSAGE_SPANS, result, sizeof(result));
+        Serial.print(F("encoding struct:             "));
+        if ((expected_len == len) && (memcmp(expected, result, len) == 0)) {
+            Serial.println(F("OK"));
+        }
+        else {
+            Serial.println(F("failed!"));
+            Serial.println(F("calculated-expected: "));
+            print_byte_comparison(result, expected, len);
+            Serial.println();
+        }
+    }
+    // invalid spans or zero positions are rejected before the output is touched
+    {
+        const uint8_t input[] = {0x11, 0x00, 0x22, 0x33, 0x00, 0x44};
+        uint8_t result[getCOBSBufferSize(sizeof(input))];
+        memset(result, 0xAA, sizeof(result));
+        const COBSNonZeroSpan unsorted[] = {{2, 2}, {0, 1}};
+        const COBSNonZeroSpan overlapping[] = {{0, 1}, {2, 2}, {3, 1}};
+        const COBSNonZeroSpan too_long[] = {{5, 2}};
+        const size_t zeros_unsorted[] = {4, 1};
+        const size_t zeros_out_of_range[] = {1, 4, 6};
+        const size_t zeros_not_zero[] = {1, 3};
+        const uint8_t bitmap_not_zero[] = {0x13};
+        bool ok = (encodeCOBS_nonzero(input, sizeof(input), unsorted, 2, result, sizeof(result)) == 0);
+        ok = ok && (encodeCOBS_nonzero(input, sizeof(input), overlapping, 3, result, sizeof(result)) == 0);
+        ok = ok && (encodeCOBS_nonzero(input, sizeof(input), too_long, 1, result, sizeof(result)) == 0);
+        ok = ok && (encodeCOBS_zeroindex(input, sizeof(input), zeros_unsorted, 2, result, sizeof(result)) == 0);
+        ok = ok && (encodeCOBS_zeroindex(input, sizeof(input), zeros_out_of_range, 3, result, sizeof(result)) == 0);
+        ok = ok && (encodeCOBS_zeroindex(input, sizeof(input), zeros_not_zero, 2, result, sizeof(result)) == 0);
+        ok = ok && (encodeCOBS_zerobitmap(input, sizeof(input), bitmap_not_zero, result, sizeof(result)) == 0);
+        for (size_t i=0; i<sizeof(result); i++) {
+            ok = ok && (result[i] == 0xAA);
+        }
+        Serial.print(F("rejecting invalid positions: "));
+        if (ok) {
+            Serial.println(F("OK"));
+        }
+        else {
+            Serial.println(F("failed!"));
+        }
+    }
+#if COBS_AEAD
+    Serial.println(F("checking ChaCha20-Poly1305 (RFC 8439 test vectors):"));
+    {
+        const char sunscreen[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+                                 "for the future, sunscreen would be it.";
+        const size_t textlen = sizeof(sunscreen) - 1;
+
+        // section 2.4.2
+        uint8_t key[32];
+        for (size_t i=0; i<sizeof(key); i++) key[i] = static_cast<uint8_t>(i);
+        const uint8_t nonce[12] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00};
+        const uint8_t cipher[] = {
+            0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+            0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+            0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+            0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+            0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+            0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+            0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+            0x87, 0x4d};
+        uint8_t buffer[textlen];
+        memcpy(buffer, sunscreen, textlen);
+        applyChaCha20(key, 1, nonce, buffer, textlen);
+        bool ok = (memcmp(buffer, cipher, textlen) == 0);
+        Serial.print(F("ChaCha20 (2.4.2):         "));
+        Serial.println(ok ? F("OK") : F("failed!"));
+
+        // section 2.5.2
+        const uint8_t poly_key[32] = {
+            0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+            0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+        const char forum[] = "Cryptographic Forum Research Group";
+        const uint8_t poly_tag[16] = {
+            0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9};
+        uint8_t tag[16];
+        computePoly1305(poly_key, reinterpret_cast<const uint8_t *>(forum), sizeof(forum) - 1, tag);
+        ok = (memcmp(tag, poly_tag, sizeof(tag)) == 0);
+        Serial.print(F("Poly1305 (2.5.2):         "));
+        Serial.println(ok ? F("OK") : F("failed!"));
+
+        // section 2.8.2: the frame is the COBS encoding of ciphertext and tag
+        uint8_t aead_key[32];
+        for (size_t i=0; i<sizeof(aead_key); i++) aead_key[i] = static_cast<uint8_t>(0x80 + i);
+        const uint8_t aead_nonce[12] = {0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+        const uint8_t aad[12] = {0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7};
+        const uint8_t sealed[] = {
+            0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+            0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe, 0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+            0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+            0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+            0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c, 0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+            0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+            0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+            0x61, 0x16,
+            // tag
+            0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a, 0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91};
+        uint8_t frame[getCOBSAeadBufferSize(textlen)];
+        uint8_t expected[getCOBSBufferSize(sizeof(sealed))];
+        size_t len = encodeCOBS_aead(aead_key, aead_nonce, aad, sizeof(aad), reinterpret_cast<const uint8_t *>(sunscreen),
+                                     textlen, frame, sizeof(frame));
+        const size_t expected_len = encodeCOBS(sealed, sizeof(sealed), expected, sizeof(expected));
+        ok = (len == expected_len) && (memcmp(frame, expected, len) == 0);
+        Serial.print(F("encodeCOBS_aead (2.8.2):  "));
+        Serial.println(ok ? F("OK") : F("failed!"));
+        len = decodeCOBS_aead(aead_key, aead_nonce, aad, sizeof(aad), frame, expected_len, frame, sizeof(frame));
+        ok = (len == textlen) && (memcmp(frame, sunscreen, len) == 0);
+        Serial.print(F("decodeCOBS_aead (2.8.2):  "));
+        Serial.println(ok ? F("OK") : F("failed!"));
+
+        // a changed byte of ciphertext, tag or additional data is rejected
+        ok = true;
+        const size_t positions[] = {1, 60, expected_len - 2};
+        for (size_t i=0; i<sizeof(positions)/sizeof(positions[0]); i++) {
+            memcpy(frame, expected, expected_len);
+            frame[positions[i]] = (frame[positions[i]] == 0x01) ? 0x02 : 0x01;
+            ok = ok && (decodeCOBS_aead(aead_key, aead_nonce, aad, sizeof(aad), frame, expected_len,
+                                        frame, sizeof(frame)) == 0);
+        }
+        uint8_t other_aad[sizeof(aad)];
+        memcpy(other_aad, aad, sizeof(aad));
+        other_aad[0] ^= 0x01;
+        memcpy(frame, expected, expected_len);
+        ok = ok && (decodeCOBS_aead(aead_key, aead_nonce, other_aad, sizeof(other_aad), frame, expected_len,
+                                    frame, sizeof(frame)) == 0);
+        Serial.print(F("rejecting forged frames:  "));
+        Serial.println(ok ? F("OK") : F("failed!"));
+    }
+#endif
     Serial.println(F("COBS unit test done!"));
     
 }
@@ -40,8 +40,27 @@
 #include <stddef.h>  // needed for size_t data type
 #include <stdint.h>  // needed for uint8_t data type
 
-size_t getCOBSBufferSize(size_t input_size,
-                         bool   with_trailing_zero=true);
+/**
+ * @brief  Calculate the maximum/worst case buffer size needed to hold the result of
+ *         a COBS encoding run.
+ * @param  input_size 
+ *         number of bytes to be encoded with COBS
+ * @param  with_trailing_zero 
+ *         Takes into account if the encoder appends
+ *         a trailing zero for packet delimiting purposes.
+ *         This adds one byte to the worst-case-length.
+ * @return maximum needed size of output buffer for the given input_size
+ * @note   Miniumum overhead is at least one byte.
+ * @note   Maximum overhead is one byte for every 254 input bytes.
+ *         The overhead is less than worst case if the stretches in the input
+ *         stream containing no zeros are shorter than 254 bytes.
+ * @note   This is a constexpr function, so it can be used for the sizes
+ *         of arrays and in static_assert().
+ */
+constexpr size_t getCOBSBufferSize(size_t input_size,
+                                   bool   with_trailing_zero=true) {
+    return input_size + input_size / 254 + 1 + (with_trailing_zero ? 1 : 0);
+}
 
 size_t encodeCOBS(const uint8_t *inptr,
                    size_t inputlen,
@@ -56,4 +75,258 @@ size_t decodeCOBS(const uint8_t *inptr,
 
 size_t decodeCOBS_inplace(uint8_t *inptr, size_t inputlen);
 
+size_t encodeCOBS_P(const uint8_t *inptr,
+                    size_t inputlen,
+                    uint8_t *outptr,
+                    size_t outlen, 
+                    bool add_trailing_zero=true);
+
+size_t decodeCOBS_P(const uint8_t *inptr,
+                    size_t inputlen,
+                    uint8_t *outptr,
+                    size_t outputlen);
+
+size_t decodeCOBS_prefix(const uint8_t *inptr,
+                         size_t inputlen,
+                         uint8_t *outptr,
+                         size_t outputlen);
+
+/*
+ * Batch decoding into a column: decoded frames back to back in one data
+ * buffer plus an array of offsets (Apache Arrow binary layout).
+ */
+size_t decodeCOBS_columnar(const uint8_t *inptr,
+                           size_t inputlen,
+                           uint8_t *data,
+                           size_t datalen,
+                           int32_t *offsets,
+                           size_t maxframes,
+                           size_t *consumed=NULL);
+
+size_t decodeCOBS_columnar(const uint8_t *inptr,
+                           size_t inputlen,
+                           uint8_t *data,
+                           size_t datalen,
+                           int64_t *offsets,
+                           size_t maxframes,
+                           size_t *consumed=NULL);
+
+size_t findCOBSDelimiter(const uint8_t *inptr, size_t inputlen);
+
+size_t findCOBSDelimiterReverse(const uint8_t *inptr, size_t inputlen);
+
+/*
+ * Transformation applied to the data in place, tile by tile, right
+ * before encoding or right after decoding (e.g. a stream cipher 
+ * combined with a MAC). Must not change the number of bytes.
+ */
+typedef void (*COBSTransform)(uint8_t *buf, size_t len, void *context);
+
+/*
+ * Stage of a pipeline: encode is applied before COBS encoding, 
+ * decode (the inverse of encode) after COBS decoding.
+ */
+struct COBSStage {
+    COBSTransform encode;
+    COBSTransform decode;
+    void         *context;
+};
+
+size_t encodeCOBS_transform(const uint8_t *inptr,
+                            size_t inputlen,
+                            uint8_t *outptr,
+                            size_t outlen,
+                            COBSTransform transform,
+                            void *context,
+                            const uint8_t *trailer=NULL,
+                            size_t trailerlen=0,
+                            bool add_trailing_zero=true);
+
+size_t decodeCOBS_transform(const uint8_t *inptr,
+                            size_t inputlen,
+                            uint8_t *outptr,
+                            size_t outputlen,
+                            COBSTransform transform,
+                            void *context,
+                            size_t trailerlen=0);
+
+size_t encodeCOBS_pipeline(const uint8_t *inptr,
+                           size_t inputlen,
+                           uint8_t *outptr,
+                           size_t outlen,
+                           const COBSStage *stages,
+                           size_t stagecount,
+                           bool add_trailing_zero=true);
+
+size_t decodeCOBS_pipeline(const uint8_t *inptr,
+                           size_t inputlen,
+                           uint8_t *outptr,
+                           size_t outputlen,
+                           const COBSStage *stages,
+                           size_t stagecount);
+
+/*
+ * Span of bytes which is known to contain no zero bytes, e.g. a field
+ * of a struct holding a magic number. Use COBS_NONZERO_FIELD() to
+ * describe a member of a struct.
+ */
+struct COBSNonZeroSpan {
+    size_t offset;
+    size_t length;
+};
+
+#define COBS_NONZERO_FIELD(type, member) \
+    { offsetof(type, member), sizeof(static_cast<type *>(0)->member) }
+
+size_t encodeCOBS_nonzero(const uint8_t *inptr,
+                          size_t inputlen,
+                          const COBSNonZeroSpan *spans,
+                          size_t spancount,
+                          uint8_t *outptr,
+                          size_t outlen,
+                          bool add_trailing_zero=true);
+
+size_t encodeCOBS_zeroindex(const uint8_t *inptr,
+                            size_t inputlen,
+                            const size_t *zeros,
+                            size_t zerocount,
+                            uint8_t *outptr,
+                            size_t outlen,
+                            bool add_trailing_zero=true);
+
+size_t encodeCOBS_zerobitmap(const uint8_t *inptr,
+                             size_t inputlen,
+                             const uint8_t *bitmap,
+                             uint8_t *outptr,
+                             size_t outlen,
+                             bool add_trailing_zero=true);
+
+/*
+ * Encode a struct directly, without serializing it first. The struct
+ * must not contain padding bytes or pointers.
+ */
+template <class T, size_t N>
+size_t encodeCOBS_struct(const T &message,
+                         const COBSNonZeroSpan (&spans)[N],
+                         uint8_t *outptr,
+                         size_t outlen,
+                         bool add_trailing_zero=true) {
+    return encodeCOBS_nonzero(reinterpret_cast<const uint8_t *>(&message), sizeof(T),
+                              spans, N, outptr, outlen, add_trailing_zero);
+}
+
+/*
+ * Incremental encoder and decoder. Both carry the COBS block state 
+ * from one call to the next, so a frame can be processed in 
+ * arbitrary chunks without buffering the complete frame first.
+ */
+class COBSEncoder {
+  public:
+    COBSEncoder();
+    void   reset();
+    size_t encode(const uint8_t *inptr,
+                  size_t inputlen,
+                  uint8_t *outptr,
+                  size_t outlen,
+                  size_t *written);
+    size_t finish(uint8_t *outptr,
+                  size_t outlen,
+                  bool add_trailing_zero=true);
+    size_t pending() const;
+  private:
+    uint8_t _block[254]; // data bytes of the not yet finished block
+    uint8_t _count;      // number of valid bytes in _block
+};
+
+class COBSDecoder {
+  public:
+    COBSDecoder();
+    void   reset();
+    size_t decode(const uint8_t *inptr,
+                  size_t inputlen,
+                  uint8_t *outptr,
+                  size_t outputlen,
+                  size_t *written);
+    bool   frameComplete() const;
+    // serialized state, e.g. for handing it over to a new process
+    static const size_t STATE_SIZE = 3;
+    size_t saveState(uint8_t *outptr, size_t outlen) const;
+    bool   restoreState(const uint8_t *inptr, size_t inputlen);
+  private:
+    uint8_t _remaining;    // data bytes left in the current block
+    bool    _zero_pending; // current block is followed by an implicit zero
+    bool    _complete;     // delimiter seen, next call starts a new frame
+};
+
+/*
+ * Segment-wise access to the result of encoding or decoding without
+ * writing it to a buffer. Each call to next() yields one block.
+ */
+class COBSEncodeSegments {
+  public:
+    COBSEncodeSegments(const uint8_t *inptr, size_t inputlen);
+    bool next(uint8_t *code, const uint8_t **data, size_t *datalen);
+  private:
+    const uint8_t *_in;
+    const uint8_t *_end;
+    bool           _done;
+};
+
+class COBSDecodeSegments {
+  public:
+    COBSDecodeSegments(const uint8_t *inptr, size_t inputlen);
+    bool next(const uint8_t **data, size_t *datalen, bool *zero_follows);
+  private:
+    const uint8_t *_in;
+    const uint8_t *_end;
+};
+
+/*
+ * COBS/R: reduced variant of COBS, which saves the byte of overhead of
+ * many small frames. decodeCOBSR() decodes plain COBS as well.
+ */
+size_t encodeCOBSR(const uint8_t *inptr,
+                   size_t inputlen,
+                   uint8_t *outptr,
+                   size_t outlen,
+                   bool add_trailing_zero=true);
+
+size_t decodeCOBSR(const uint8_t *inptr,
+                   size_t inputlen,
+                   uint8_t *outptr,
+                   size_t outputlen);
+
+/*
+ * Negotiation of the framing variant per link. Both sides send a hello
+ * frame (plain COBS) with the features they support and switch to the
+ * best common variant. Unknown feature bits are ignored, so older peers
+ * fall back to what they know.
+ */
+#define COBS_FEATURE_COBSR      0x01
+#define COBS_FEATURES_SUPPORTED (COBS_FEATURE_COBSR)
+#define COBS_HELLO_BUFFER_SIZE  8
+
+class COBSNegotiator {
+  public:
+    explicit COBSNegotiator(uint8_t features=COBS_FEATURES_SUPPORTED);
+    void    reset();
+    size_t  hello(uint8_t *outptr, size_t outlen, bool reply=false);
+    bool    receive(const uint8_t *frame, size_t framelen);
+    bool    replyPending() const;
+    uint8_t features() const;
+    size_t  encode(const uint8_t *inptr,
+                   size_t inputlen,
+                   uint8_t *outptr,
+                   size_t outlen,
+                   bool add_trailing_zero=true) const;
+    size_t  decode(const uint8_t *inptr,
+                   size_t inputlen,
+                   uint8_t *outptr,
+                   size_t outputlen) const;
+  private:
+    uint8_t _local;          // features of this side
+    uint8_t _agreed;         // features of both sides
+    bool    _reply_pending;  // peer sent a hello which is not a reply
+};
+
 #endif
@@ -0,0 +1,451 @@
+/**
+ * @file    cobs_aead.cpp
+ * @brief   ChaCha20-Poly1305 (RFC 8439) fused with COBS encoding and decoding.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cobs_aead.h"
+
+#if COBS_AEAD
+
+static inline uint32_t load32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+           | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static inline uint32_t rotate(uint32_t v, unsigned n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+// Overwrite secrets in a way the compiler does not optimize away.
+static void wipe(void *ptr, size_t len) {
+    volatile uint8_t *p = static_cast<volatile uint8_t *>(ptr);
+    while (len-- > 0) *p++ = 0;
+}
+
+/*
+ * ChaCha20 (RFC 8439, section 2.4): XOR with a key stream which is
+ * generated one block of 64 bytes at a time.
+ */
+struct ChaCha20 {
+    uint32_t state[16];
+    uint8_t  stream[64];
+    uint8_t  used;     // bytes of stream already used
+};
+
+static inline void quarterRound(uint32_t *x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotate(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotate(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotate(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotate(x[b] ^ x[c], 7);
+}
+
+static void chachaInit(ChaCha20 *c, const uint8_t *key, uint32_t counter, const uint8_t *nonce) {
+    c->state[0] = 0x61707865;
+    c->state[1] = 0x3320646e;
+    c->state[2] = 0x79622d32;
+    c->state[3] = 0x6b206574;
+    for (int i=0; i<8; i++) c->state[4 + i] = load32(key + 4 * i);
+    c->state[12] = counter;
+    for (int i=0; i<3; i++) c->state[13 + i] = load32(nonce + 4 * i);
+    c->used = 64;
+}
+
+// Generate the next block of the key stream.
+static void chachaBlock(ChaCha20 *c) {
+    uint32_t x[16];
+    for (int i=0; i<16; i++) x[i] = c->state[i];
+    for (int i=0; i<10; i++) {
+        quarterRound(x, 0, 4,  8, 12);
+        quarterRound(x, 1, 5,  9, 13);
+        quarterRound(x, 2, 6, 10, 14);
+        quarterRound(x, 3, 7, 11, 15);
+        quarterRound(x, 0, 5, 10, 15);
+        quarterRound(x, 1, 6, 11, 12);
+        quarterRound(x, 2, 7,  8, 13);
+        quarterRound(x, 3, 4,  9, 14);
+    }
+    for (int i=0; i<16; i++) store32(c->stream + 4 * i, x[i] + c->state[i]);
+    c->state[12]++;
+    c->used = 0;
+    wipe(x, sizeof(x));
+}
+
+static void chachaXor(ChaCha20 *c, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        if (c->used == 64) chachaBlock(c);
+        size_t n = 64u - c->used;
+        if (len < n) n = len;
+        const uint8_t *stream = c->stream + c->used;
+        for (size_t i=0; i<n; i++) buf[i] ^= stream[i];
+        c->used = static_cast<uint8_t>(c->used + n);
+        buf += n;
+        len -= n;
+    }
+}
+
+/*
+ * Poly1305 (RFC 8439, section 2.5) with 26 bit limbs, so all products
+ * fit into 64 bits and no 128 bit arithmetic is needed.
+ */
+struct Poly1305 {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+    uint8_t  buffer[16];
+    uint8_t  buffered; // bytes in buffer, also the position modulo 16
+};
+
+static void polyInit(Poly1305 *p, const uint8_t *key) {
+    // clamp r
+    p->r[0] = (load32(key +  0)     ) & 0x3ffffff;
+    p->r[1] = (load32(key +  3) >> 2) & 0x3ffff03;
+    p->r[2] = (load32(key +  6) >> 4) & 0x3ffc0ff;
+    p->r[3] = (load32(key +  9) >> 6) & 0x3f03fff;
+    p->r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+    for (int i=0; i<5; i++) p->h[i] = 0;
+    for (int i=0; i<4; i++) p->pad[i] = load32(key + 16 + 4 * i);
+    p->buffered = 0;
+}
+
+// Add a block of 16 bytes and multiply by r. hibit is 1 << 24 for full
+// blocks; the last, padded block has its 1 bit within the 16 bytes.
+static void polyBlock(Poly1305 *p, const uint8_t *m, uint32_t hibit) {
+    const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3], r4 = p->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+
+    h0 += (load32(m +  0)     ) & 0x3ffffff;
+    h1 += (load32(m +  3) >> 2) & 0x3ffffff;
+    h2 += (load32(m +  6) >> 4) & 0x3ffffff;
+    h3 += (load32(m +  9) >> 6) & 0x3ffffff;
+    h4 += (load32(m + 12) >> 8) | hibit;
+
+    const uint64_t d0 = static_cast<uint64_t>(h0) * r0 + static_cast<uint64_t>(h1) * s4
+                        + static_cast<uint64_t>(h2) * s3 + static_cast<uint64_t>(h3) * s2
+                        + static_cast<uint64_t>(h4) * s1;
+    uint64_t d1 = static_cast<uint64_t>(h0) * r1 + static_cast<uint64_t>(h1) * r0
+                  + static_cast<uint64_t>(h2) * s4 + static_cast<uint64_t>(h3) * s3
+                  + static_cast<uint64_t>(h4) * s2;
+    uint64_t d2 = static_cast<uint64_t>(h0) * r2 + static_cast<uint64_t>(h1) * r1
+                  + static_cast<uint64_t>(h2) * r0 + static_cast<uint64_t>(h3) * s4
+                  + static_cast<uint64_t>(h4) * s3;
+    uint64_t d3 = static_cast<uint64_t>(h0) * r3 + static_cast<uint64_t>(h1) * r2
+                  + static_cast<uint64_t>(h2) * r1 + static_cast<uint64_t>(h3) * r0
+                  + static_cast<uint64_t>(h4) * s4;
+    uint64_t d4 = static_cast<uint64_t>(h0) * r4 + static_cast<uint64_t>(h1) * r3
+                  + static_cast<uint64_t>(h2) * r2 + static_cast<uint64_t>(h3) * r1
+                  + static_cast<uint64_t>(h4) * r0;
+
+    // partial reduction modulo 2^130 - 5
+    uint32_t c = static_cast<uint32_t>(d0 >> 26); h0 = static_cast<uint32_t>(d0) & 0x3ffffff;
+    d1 += c; c = static_cast<uint32_t>(d1 >> 26); h1 = static_cast<uint32_t>(d1) & 0x3ffffff;
+    d2 += c; c = static_cast<uint32_t>(d2 >> 26); h2 = static_cast<uint32_t>(d2) & 0x3ffffff;
+    d3 += c; c = static_cast<uint32_t>(d3 >> 26); h3 = static_cast<uint32_t>(d3) & 0x3ffffff;
+    d4 += c; c = static_cast<uint32_t>(d4 >> 26); h4 = static_cast<uint32_t>(d4) & 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    p->h[0] = h0; p->h[1] = h1; p->h[2] = h2; p->h[3] = h3; p->h[4] = h4;
+}
+
+static void polyUpdate(Poly1305 *p, const uint8_t *m, size_t len) {
+    if (p->buffered > 0) {
+        while (len > 0 && p->buffered < 16) {
+            p->buffer[p->buffered++] = *m++;
+            len--;
+        }
+        if (p->buffered < 16) return;
+        polyBlock(p, p->buffer, 1UL << 24);
+        p->buffered = 0;
+    }
+    while (len >= 16) {
+        polyBlock(p, m, 1UL << 24);
+        m += 16;
+        len -= 16;
+    }
+    while (len > 0) {
+        p->buffer[p->buffered++] = *m++;
+        len--;
+    }
+}
+
+// Fill up the last block with zero bytes (padding of AEAD, section 2.8).
+static void polyPad(Poly1305 *p) {
+    static const uint8_t zeros[16] = {0};
+    if (p->buffered > 0) polyUpdate(p, zeros, 16u - p->buffered);
+}
+
+static void polyFinish(Poly1305 *p, uint8_t *tag) {
+    if (p->buffered > 0) {
+        p->buffer[p->buffered++] = 1;
+        while (p->buffered < 16) p->buffer[p->buffered++] = 0;
+        polyBlock(p, p->buffer, 0);
+    }
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+
+    // full carry
+    uint32_t c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // g = h + 5 - 2^130, take it instead of h if it is not negative
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - static_cast<uint32_t>(1UL << 26);
+    uint32_t mask = (g4 >> 31) - 1; // all ones if g is not negative
+    g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+    mask = ~mask;
+    h0 = (h0 & mask) | g0;
+    h1 = (h1 & mask) | g1;
+    h2 = (h2 & mask) | g2;
+    h3 = (h3 & mask) | g3;
+    h4 = (h4 & mask) | g4;
+
+    // h modulo 2^128, plus s
+    h0 = (h0      ) | (h1 << 26);
+    h1 = (h1 >>  6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 <<  8);
+    uint64_t f = static_cast<uint64_t>(h0) + p->pad[0];
+    store32(tag +  0, static_cast<uint32_t>(f));
+    f = static_cast<uint64_t>(h1) + p->pad[1] + (f >> 32);
+    store32(tag +  4, static_cast<uint32_t>(f));
+    f = static_cast<uint64_t>(h2) + p->pad[2] + (f >> 32);
+    store32(tag +  8, static_cast<uint32_t>(f));
+    f = static_cast<uint64_t>(h3) + p->pad[3] + (f >> 32);
+    store32(tag + 12, static_cast<uint32_t>(f));
+}
+
+/*
+ * State of ChaCha20-Poly1305 (RFC 8439, section 2.8) while a frame is
+ * encoded or decoded. Passed to the tile transformations as context.
+ */
+struct AeadContext {
+    ChaCha20 cipher;
+    Poly1305 mac;
+    uint64_t aadlen;
+    uint64_t textlen;
+    uint8_t  tag[COBS_AEAD_TAG_SIZE];
+};
+
+static void aeadInit(AeadContext *ctx, const uint8_t *key, const uint8_t *nonce,
+                     const uint8_t *aad, size_t aadlen) {
+    // the first block of the key stream is the one-time key of Poly1305
+    uint8_t otk[64] = {0};
+    chachaInit(&ctx->cipher, key, 0, nonce);
+    chachaXor(&ctx->cipher, otk, sizeof(otk));
+    polyInit(&ctx->mac, otk);
+    wipe(otk, sizeof(otk));
+    polyUpdate(&ctx->mac, aad, aadlen);
+    polyPad(&ctx->mac);
+    ctx->aadlen = aadlen;
+    ctx->textlen = 0;
+}
+
+// After the ciphertext: padding, both lengths and the tag.
+static void aeadFinish(AeadContext *ctx) {
+    uint8_t lengths[16];
+    polyPad(&ctx->mac);
+    store32(lengths +  0, static_cast<uint32_t>(ctx->aadlen));
+    store32(lengths +  4, static_cast<uint32_t>(ctx->aadlen >> 32));
+    store32(lengths +  8, static_cast<uint32_t>(ctx->textlen));
+    store32(lengths + 12, static_cast<uint32_t>(ctx->textlen >> 32));
+    polyUpdate(&ctx->mac, lengths, sizeof(lengths));
+    polyFinish(&ctx->mac, ctx->tag);
+}
+
+// COBSTransform for encoding: encrypt, then add the ciphertext to the MAC.
+static void encryptTile(uint8_t *buf, size_t len, void *context) {
+    AeadContext *ctx = static_cast<AeadContext *>(context);
+    if (len == 0) {
+        aeadFinish(ctx);
+        return;
+    }
+    chachaXor(&ctx->cipher, buf, len);
+    polyUpdate(&ctx->mac, buf, len);
+    ctx->textlen += len;
+}
+
+// COBSTransform for decoding: add the ciphertext to the MAC, then decrypt.
+static void decryptTile(uint8_t *buf, size_t len, void *context) {
+    AeadContext *ctx = static_cast<AeadContext *>(context);
+    if (len == 0) {
+        aeadFinish(ctx);
+        return;
+    }
+    polyUpdate(&ctx->mac, buf, len);
+    chachaXor(&ctx->cipher, buf, len);
+    ctx->textlen += len;
+}
+
+// The block counter must not wrap: at most 2^32 - 1 blocks of 64 bytes.
+static const uint64_t AEAD_MAX_TEXT = 0xFFFFFFFFULL * 64ULL;
+
+/**
+ * @brief  Encrypt a buffer of bytes with ChaCha20-Poly1305 and encode the
+ *         ciphertext and the tag using the COBS algorithm in a single
+ *         pass (see encodeCOBS_transform()). The input is not modified.
+ * @param  key
+ *         COBS_AEAD_KEY_SIZE bytes
+ * @param  nonce
+ *         COBS_AEAD_NONCE_SIZE bytes. Never use a nonce twice with the
+ *         same key.
+ * @param  aad
+ *         Additional data which is authenticated, but neither encrypted
+ *         nor sent (e.g. a header sent in the clear). May be NULL.
+ * @param  aadlen
+ *         number of bytes in aad
+ * @param  inptr
+ *         pointer to buffer with plain bytes
+ * @param  inputlen
+ *         number of bytes to take from input buffer
+ * @param  outptr
+ *         pointer to buffer to write encoded bytes to
+ * @param  outlen
+ *         The maximum size of the output buffer. Must be at least
+ *         getCOBSAeadBufferSize(inputlen, add_trailing_zero).
+ * @param  add_trailing_zero
+ *         when this is true, a zero byte will be appended
+ *         to the output written to output_buffer.
+ * @return Number of bytes written to buffer outptr. If the output buffer
+ *         is too small, return 0.
+ */
+size_t encodeCOBS_aead(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadlen,
+                       const uint8_t *inptr, size_t inputlen, uint8_t *outptr, size_t outlen,
+                       bool add_trailing_zero) {
+    if (static_cast<uint64_t>(inputlen) > AEAD_MAX_TEXT) {
+        return 0;
+    }
+    AeadContext ctx;
+    aeadInit(&ctx, key, nonce, aad, aadlen);
+    const size_t len = encodeCOBS_transform(inptr, inputlen, outptr, outlen, encryptTile, &ctx,
+                                            ctx.tag, COBS_AEAD_TAG_SIZE, add_trailing_zero);
+    wipe(&ctx, sizeof(ctx));
+    return len;
+}
+
+/**
+ * @brief  Decode a frame written by encodeCOBS_aead(), decrypt it and
+ *         check its tag in a single pass (see decodeCOBS_transform()).
+ * @param  key
+ *         COBS_AEAD_KEY_SIZE bytes
+ * @param  nonce
+ *         COBS_AEAD_NONCE_SIZE bytes
+ * @param  aad
+ *         same additional data as for encoding, may be NULL
+ * @param  aadlen
+ *         number of bytes in aad
+ * @param  inptr
+ *         Pointer to buffer with COBS encoded bytes to decode.
+ * @param  inputlen
+ *         Maximum number of bytes to take from input buffer to decode.
+ *         Same as for decodeCOBS().
+ * @param  outptr
+ *         Pointer to buffer into which to write the decoded bytes.
+ *         May be the same as inptr.
+ * @param  outputlen
+ *         Maximum number of bytes the output buffer can hold.
+ *         Same as for decodeCOBS().
+ * @return Number of plain bytes in buffer outptr. 0 if the frame is
+ *         invalid or the tag does not match. In this case, the output
+ *         buffer is cleared, so no unauthenticated plain bytes remain.
+ * @note   The tag follows the plain bytes in the output buffer.
+ */
+size_t decodeCOBS_aead(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadlen,
+                       const uint8_t *inptr, size_t inputlen, uint8_t *outptr, size_t outputlen) {
+    AeadContext ctx;
+    aeadInit(&ctx, key, nonce, aad, aadlen);
+    size_t len = decodeCOBS_transform(inptr, inputlen, outptr, outputlen, decryptTile, &ctx,
+                                      COBS_AEAD_TAG_SIZE);
+    uint8_t diff = (len < COBS_AEAD_TAG_SIZE) ? 1 : 0;
+    if (diff == 0) {
+        // compare in constant time
+        const uint8_t *tag = outptr + len - COBS_AEAD_TAG_SIZE;
+        for (size_t i=0; i<COBS_AEAD_TAG_SIZE; i++) diff |= tag[i] ^ ctx.tag[i];
+    }
+    wipe(&ctx, sizeof(ctx));
+    if (diff != 0) {
+        wipe(outptr, (len > 0) ? len : outputlen);
+        return 0;
+    }
+    return len - COBS_AEAD_TAG_SIZE;
+}
+
+/**
+ * @brief  XOR a buffer with the ChaCha20 key stream (RFC 8439,
+ *         section 2.4), i.e. encrypt or decrypt it in place.
+ * @param  key
+ *         32 bytes
+ * @param  counter
+ *         block counter of the first 64 bytes
+ * @param  nonce
+ *         12 bytes
+ * @param  buf
+ *         bytes to encrypt or decrypt
+ * @param  len
+ *         number of bytes in buf
+ */
+void applyChaCha20(const uint8_t *key, uint32_t counter, const uint8_t *nonce, uint8_t *buf, size_t len) {
+    ChaCha20 cipher;
+    chachaInit(&cipher, key, counter, nonce);
+    chachaXor(&cipher, buf, len);
+    wipe(&cipher, sizeof(cipher));
+}
+
+/**
+ * @brief  Calculate the Poly1305 MAC of a message (RFC 8439, section 2.5).
+ * @param  key
+ *         32 bytes, used for one message only
+ * @param  msg
+ *         the message
+ * @param  len
+ *         number of bytes in msg
+ * @param  tag
+ *         buffer for the 16 bytes of the MAC
+ */
+void computePoly1305(const uint8_t *key, const uint8_t *msg, size_t len, uint8_t *tag) {
+    Poly1305 mac;
+    polyInit(&mac, key);
+    polyUpdate(&mac, msg, len);
+    polyFinish(&mac, tag);
+    wipe(&mac, sizeof(mac));
+}
+
+#endif // COBS_AEAD
@@ -0,0 +1,106 @@
+/**
+ * @file    cobs_aead.h
+ * @brief   ChaCha20-Poly1305 (RFC 8439) fused with COBS encoding and decoding.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_aead_h
+#define ConsistentOverheadByteStuffing_aead_h
+
+/*
+ * Authenticated encryption built on encodeCOBS_transform() and
+ * decodeCOBS_transform(): each tile is encrypted, added to the MAC and
+ * COBS encoded while it is still in the cache, and the tag is encoded
+ * as the trailer. Decoding runs the other way round.
+ *
+ * Optional: nothing is compiled unless COBS_AEAD is set to 1, e.g. with
+ * -DCOBS_AEAD=1 for all sources. The code is portable C++ without
+ * assembler or SIMD and is not hardened against timing side channels
+ * beyond the constant-time tag comparison.
+ */
+#include "cobs.h"
+
+#ifndef COBS_AEAD
+#define COBS_AEAD 0
+#endif
+
+#if COBS_AEAD
+
+constexpr size_t COBS_AEAD_KEY_SIZE   = 32;
+constexpr size_t COBS_AEAD_NONCE_SIZE = 12;
+constexpr size_t COBS_AEAD_TAG_SIZE   = 16;
+
+/**
+ * @brief  Calculate the buffer size needed by encodeCOBS_aead().
+ * @param  input_size
+ *         number of plain bytes
+ * @param  with_trailing_zero
+ *         same as for getCOBSBufferSize()
+ * @return maximum size of the encoded frame, including the tag
+ */
+constexpr size_t getCOBSAeadBufferSize(size_t input_size,
+                                       bool   with_trailing_zero=true) {
+    return getCOBSBufferSize(input_size + COBS_AEAD_TAG_SIZE, with_trailing_zero);
+}
+
+size_t encodeCOBS_aead(const uint8_t *key,
+                       const uint8_t *nonce,
+                       const uint8_t *aad,
+                       size_t aadlen,
+                       const uint8_t *inptr,
+                       size_t inputlen,
+                       uint8_t *outptr,
+                       size_t outlen,
+                       bool add_trailing_zero=true);
+
+size_t decodeCOBS_aead(const uint8_t *key,
+                       const uint8_t *nonce,
+                       const uint8_t *aad,
+                       size_t aadlen,
+                       const uint8_t *inptr,
+                       size_t inputlen,
+                       uint8_t *outptr,
+                       size_t outputlen);
+
+/*
+ * The primitives on their own, e.g. for checking them against the test
+ * vectors of RFC 8439.
+ */
+void applyChaCha20(const uint8_t *key,
+                   uint32_t counter,
+                   const uint8_t *nonce,
+                   uint8_t *buf,
+                   size_t len);
+
+void computePoly1305(const uint8_t *key,
+                     const uint8_t *msg,
+                     size_t len,
+                     uint8_t *tag);
+
+#endif // COBS_AEAD
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * @file    cobs_broadcast.h
+ * @brief   Encode a frame once and send it on many streams.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_broadcast_h
+#define ConsistentOverheadByteStuffing_broadcast_h
+
+/*
+ * A frame is encoded once into a COBSSharedFrame and then put on the 
+ * transmit queues of any number of streams. Each queue holds a reference
+ * to the frame, the encoded bytes are not copied. When the last queue
+ * has written the frame, a release function is called, e.g. to return
+ * the buffer to a pool.
+ *
+ * The stream type of the queues is a template parameter, see 
+ * cobs_stream.h. It needs this method:
+ *   size_t write(const uint8_t *buffer, size_t size);
+ * write() may accept fewer bytes than offered, the rest is written by
+ * the next call to poll().
+ */
+#include "cobs.h"
+
+/**
+ * @brief  Reference counted, immutable COBS encoded frame in a buffer 
+ *         provided by the caller.
+ */
+class COBSSharedFrame {
+  public:
+    typedef void (*ReleaseFunction)(COBSSharedFrame *frame, void *context);
+
+    COBSSharedFrame() : _data(0), _length(0), _refs(0), _release(0), _context(0) {}
+
+    /**
+     * @brief  Encode a frame into a buffer. Afterwards, the caller holds
+     *         one reference to the frame and must call release() when it
+     *         has put the frame on all queues.
+     * @param  inptr
+     *         pointer to buffer with bytes to encode
+     * @param  inputlen
+     *         number of bytes to encode
+     * @param  buffer
+     *         buffer for the encoded frame, must stay valid until the 
+     *         frame is released
+     * @param  bufferlen
+     *         size of buffer, see getCOBSBufferSize()
+     * @param  release_function
+     *         called when the last reference is released (may be NULL)
+     * @param  context
+     *         passed to release_function
+     * @return false if the buffer is too small or the frame is still in use
+     */
+    bool encode(const uint8_t *inptr, size_t inputlen, uint8_t *buffer, size_t bufferlen,
+                ReleaseFunction release_function=0, void *context=0) {
+        if (references() > 0) return false;
+        _length = encodeCOBS(inptr, inputlen, buffer, bufferlen);
+        if (_length == 0) return false;
+        _data = buffer;
+        _release = release_function;
+        _context = context;
+        _refs = 1;
+        return true;
+    }
+
+    const uint8_t *data() const {
+        return _data;
+    }
+
+    size_t length() const {
+        return _length;
+    }
+
+    // The reference count is changed atomically where the compiler
+    // supports it, so queues may be served by different threads.
+    void retain() {
+#if defined(__GNUC__) && !defined(__AVR__)
+        __atomic_add_fetch(&_refs, 1, __ATOMIC_RELAXED);
+#else
+        _refs++;
+#endif
+    }
+
+    void release() {
+#if defined(__GNUC__) && !defined(__AVR__)
+        if (__atomic_sub_fetch(&_refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+#else
+        if (--_refs != 0) return;
+#endif
+        if (_release) _release(this, _context);
+    }
+
+    size_t references() const {
+#if defined(__GNUC__) && !defined(__AVR__)
+        return __atomic_load_n(&_refs, __ATOMIC_ACQUIRE);
+#else
+        return _refs;
+#endif
+    }
+
+  private:
+    // not copyable, queues hold pointers to it
+    COBSSharedFrame(const COBSSharedFrame &);
+    COBSSharedFrame &operator=(const COBSSharedFrame &);
+
+    const uint8_t  *_data;
+    size_t          _length;
+    size_t          _refs;
+    ReleaseFunction _release;
+    void           *_context;
+};
+
+/**
+ * @brief  Queue of shared frames to write to one stream.
+ * @tparam StreamType
+ *         type of the stream
+ * @tparam N
+ *         maximum number of queued frames
+ */
+template <class StreamType, size_t N>
+class COBSTransmitQueue {
+  public:
+    explicit COBSTransmitQueue(StreamType &stream) : _stream(stream), _head(0), _count(0), _offset(0) {}
+
+    ~COBSTransmitQueue() {
+        clear();
+    }
+
+    /**
+     * @brief  Put a frame on the queue. The queue takes a reference to it.
+     * @return false if the queue is full
+     */
+    bool push(COBSSharedFrame *frame) {
+        if (_count == N) return false;
+        frame->retain();
+        _frames[(_head + _count) % N] = frame;
+        _count++;
+        return true;
+    }
+
+    /**
+     * @brief  Write queued frames to the stream until the queue is empty
+     *         or the stream does not accept more bytes.
+     * @return number of bytes written
+     */
+    size_t poll() {
+        size_t total = 0;
+        while (_count > 0) {
+            COBSSharedFrame *frame = _frames[_head];
+            const size_t len = frame->length() - _offset;
+            const size_t n = _stream.write(frame->data() + _offset, len);
+            total += n;
+            if (n < len) {
+                _offset += n;
+                break;
+            }
+            pop();
+        }
+        return total;
+    }
+
+    /**
+     * @brief  Drop all queued frames.
+     */
+    void clear() {
+        while (_count > 0) pop();
+    }
+
+    size_t queued() const {
+        return _count;
+    }
+
+  private:
+    void pop() {
+        COBSSharedFrame *frame = _frames[_head];
+        _head = (_head + 1) % N;
+        _count--;
+        _offset = 0;
+        frame->release();
+    }
+
+    StreamType      &_stream;
+    COBSSharedFrame *_frames[N];
+    size_t           _head;
+    size_t           _count;
+    size_t           _offset;  // bytes of the first frame already written
+};
+
+/**
+ * @brief  Put a shared frame on many transmit queues.
+ * @param  frame
+ *         encoded frame
+ * @param  queues
+ *         array of pointers to the queues
+ * @param  queuecount
+ *         number of queues
+ * @return Number of queues which accepted the frame. The others are full.
+ */
+template <class QueueType>
+size_t broadcastCOBS(COBSSharedFrame &frame, QueueType *const *queues, size_t queuecount) {
+    size_t accepted = 0;
+    for (size_t i=0; i<queuecount; i++) {
+        if (queues[i]->push(&frame)) accepted++;
+    }
+    return accepted;
+}
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ * @file    cobs_endpoint.h
+ * @brief   Many framed endpoints sharing one pool of buffers.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_endpoint_h
+#define ConsistentOverheadByteStuffing_endpoint_h
+
+/*
+ * A COBSStreamReader and a transmit buffer per connection cost 
+ * 2 * getCOBSBufferSize() bytes, even while the connection is idle. With
+ * thousands of connections, most of this memory is never used. Here, a 
+ * connection (COBSEndpoint) only keeps the state of the decoder and of 
+ * its queues, and borrows blocks from a shared COBSEndpointPool while a
+ * frame is received or waiting to be sent. The number of blocks one 
+ * endpoint may hold is limited by its quota.
+ */
+#include <string.h>
+#include "cobs.h"
+#include "cobs_stream.h"  // needed for readCOBSBuffered()
+
+template <size_t BlockSize, size_t Blocks>
+class COBSEndpointPool;
+
+/**
+ * @brief  State of one endpoint. Holds no buffers by itself.
+ */
+class COBSEndpoint {
+  public:
+    /**
+     * @param  quota
+     *         maximum number of blocks the endpoint may borrow for 
+     *         receiving and sending at the same time
+     */
+    explicit COBSEndpoint(uint8_t quota=2)
+        : _rx_block(NO_BLOCK), _in_pos(0), _in_len(0), _out_len(0),
+          _tx_head(NO_BLOCK), _tx_tail(NO_BLOCK), _tx_pos(0), _dropped(0),
+          _quota(quota), _held(0), _frame_ready(false), _skipping(false) {}
+
+    /**
+     * @brief  Get the number of blocks borrowed from the pool.
+     * @return number of blocks, 0 while the endpoint is idle
+     */
+    uint8_t blocks() const {
+        return _held;
+    }
+
+    /**
+     * @brief  Get the number of received frames dropped because they 
+     *         were too long.
+     * @return number of dropped frames
+     */
+    uint16_t dropped() const {
+        return _dropped;
+    }
+
+  private:
+    template <size_t, size_t> friend class COBSEndpointPool;
+    static const uint16_t NO_BLOCK = 0xFFFF;
+
+    COBSDecoder _decoder;
+    uint16_t    _rx_block;    // block for receiving, NO_BLOCK if none
+    uint16_t    _in_pos;      // see readCOBSBuffered()
+    uint16_t    _in_len;
+    uint16_t    _out_len;
+    uint16_t    _tx_head;     // queue of encoded frames, linked by the pool
+    uint16_t    _tx_tail;
+    uint16_t    _tx_pos;      // bytes of the first frame already written
+    uint16_t    _dropped;
+    uint8_t     _quota;
+    uint8_t     _held;        // blocks borrowed
+    bool        _frame_ready;
+    bool        _skipping;
+};
+
+/**
+ * @brief  Blocks of memory shared by many endpoints.
+ * @tparam BlockSize
+ *         Size of a block. This is the maximum length of a received 
+ *         frame after decoding and of a frame to send after encoding.
+ * @tparam Blocks
+ *         number of blocks
+ */
+template <size_t BlockSize, size_t Blocks>
+class COBSEndpointPool {
+    static_assert(BlockSize > 1 && BlockSize < 0xFFFF, "BlockSize must be 2...65534");
+    static_assert(Blocks > 0 && Blocks < 0xFFFF, "Blocks must be 1...65534");
+  public:
+    COBSEndpointPool() : _free(0), _available(Blocks) {
+        for (size_t i=0; i<Blocks; i++) {
+            _next[i] = static_cast<uint16_t>((i + 1 < Blocks) ? i + 1 : COBSEndpoint::NO_BLOCK);
+        }
+    }
+
+    /**
+     * @brief  Read all available bytes of an endpoint from its stream 
+     *         (but do not wait for more) and decode them. Works like 
+     *         COBSStreamReader::read(). A block is borrowed when bytes 
+     *         arrive and given back when no frame is in progress. If no
+     *         block can be borrowed, the bytes are left in the stream.
+     * @param  ep
+     *         the endpoint
+     * @param  stream
+     *         stream of the endpoint
+     * @return Length of the decoded frame if a frame is complete, 0 otherwise.
+     *         The decoded frame can be accessed with frame() and is valid
+     *         until the next call to read(). Call read() until it returns
+     *         0, so the block is given back.
+     */
+    template <class StreamType>
+    size_t read(COBSEndpoint &ep, StreamType &stream) {
+        if (ep._rx_block == COBSEndpoint::NO_BLOCK) {
+            if (stream.available() <= 0 || !borrow(ep, &ep._rx_block)) return 0;
+        }
+        const size_t len = readCOBSBuffered(stream, _data[ep._rx_block], BlockSize, ep._decoder,
+                                            ep._in_pos, ep._in_len, ep._out_len, ep._dropped,
+                                            ep._frame_ready, ep._skipping);
+        if (len == 0 && ep._in_len == 0) {
+            // no frame in progress
+            giveBack(ep, ep._rx_block);
+            ep._rx_block = COBSEndpoint::NO_BLOCK;
+        }
+        return len;
+    }
+
+    /**
+     * @brief  Get the last frame returned by read() for an endpoint.
+     * @return pointer to the decoded bytes
+     */
+    const uint8_t *frame(const COBSEndpoint &endpoint) const {
+        return _data[endpoint._rx_block];
+    }
+
+    /**
+     * @brief  Encode a frame into a block and queue it for sending.
+     * @param  endpoint
+     *         the endpoint
+     * @param  inptr
+     *         pointer to buffer with bytes to encode
+     * @param  inputlen
+     *         number of bytes to encode, getCOBSBufferSize(inputlen) must
+     *         not exceed BlockSize
+     * @return false if the frame is too long, the quota of the endpoint 
+     *         is used up or the pool is empty
+     */
+    bool send(COBSEndpoint &endpoint, const uint8_t *inptr, size_t inputlen) {
+        if (getCOBSBufferSize(inputlen) > BlockSize) return false;
+        uint16_t block;
+        if (!borrow(endpoint, &block)) return false;
+        _length[block] = static_cast<uint16_t>(encodeCOBS(inptr, inputlen, _data[block], BlockSize));
+        _next[block] = COBSEndpoint::NO_BLOCK;
+        if (endpoint._tx_tail == COBSEndpoint::NO_BLOCK) {
+            endpoint._tx_head = block;
+        }
+        else {
+            _next[endpoint._tx_tail] = block;
+        }
+        endpoint._tx_tail = block;
+        return true;
+    }
+
+    /**
+     * @brief  Write queued frames of an endpoint, as many bytes as the 
+     *         stream accepts without blocking. Blocks of frames which 
+     *         are written completely are given back.
+     * @return number of bytes written
+     */
+    template <class StreamType>
+    size_t poll(COBSEndpoint &endpoint, StreamType &stream) {
+        size_t total = 0;
+        while (endpoint._tx_head != COBSEndpoint::NO_BLOCK) {
+            const uint16_t block = endpoint._tx_head;
+            const int room = stream.availableForWrite();
+            if (room <= 0) break;
+            size_t len = _length[block] - endpoint._tx_pos;
+            if (static_cast<size_t>(room) < len) len = static_cast<size_t>(room);
+            const size_t written = stream.write(_data[block] + endpoint._tx_pos, len);
+            total += written;
+            endpoint._tx_pos = static_cast<uint16_t>(endpoint._tx_pos + written);
+            if (endpoint._tx_pos < _length[block]) break;
+            endpoint._tx_pos = 0;
+            endpoint._tx_head = _next[block];
+            if (endpoint._tx_head == COBSEndpoint::NO_BLOCK) endpoint._tx_tail = COBSEndpoint::NO_BLOCK;
+            giveBack(endpoint, block);
+        }
+        return total;
+    }
+
+    /**
+     * @brief  Give back all blocks of an endpoint, e.g. when its 
+     *         connection is closed. The endpoint can be used again.
+     */
+    void close(COBSEndpoint &endpoint) {
+        while (endpoint._tx_head != COBSEndpoint::NO_BLOCK) {
+            const uint16_t block = endpoint._tx_head;
+            endpoint._tx_head = _next[block];
+            giveBack(endpoint, block);
+        }
+        if (endpoint._rx_block != COBSEndpoint::NO_BLOCK) giveBack(endpoint, endpoint._rx_block);
+        endpoint = COBSEndpoint(endpoint._quota);
+    }
+
+    /**
+     * @brief  Get the number of free blocks.
+     * @return number of blocks
+     */
+    size_t available() const {
+        return _available;
+    }
+
+    /**
+     * @brief  Get the RAM used by the pool.
+     * @return size in bytes
+     */
+    static constexpr size_t ramUsage() {
+        return sizeof(COBSEndpointPool);
+    }
+
+  private:
+    bool borrow(COBSEndpoint &endpoint, uint16_t *block) {
+        if (_free == COBSEndpoint::NO_BLOCK || endpoint._held >= endpoint._quota) return false;
+        *block = _free;
+        _free = _next[_free];
+        _available--;
+        endpoint._held++;
+        return true;
+    }
+
+    void giveBack(COBSEndpoint &endpoint, uint16_t block) {
+        _next[block] = _free;
+        _free = block;
+        _available++;
+        endpoint._held--;
+    }
+
+    uint8_t  _data[Blocks][BlockSize];
+    uint16_t _length[Blocks];  // length of an encoded frame to send
+    uint16_t _next[Blocks];    // next free block or next frame to send
+    uint16_t _free;            // first free block
+    size_t   _available;
+};
+
+#endif
@@ -0,0 +1,256 @@
+/**
+ * @file    cobs_escape.cpp
+ * @brief   SLIP and HDLC byte stuffing.
+ * @author  Andreas Grommek
+ * 
+ * @section license License
+ * 
+ * The MIT Licence (MIT)
+ * 
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+#include "cobs_escape.h"
+#include <string.h>  // needed for memchr(), memcpy(), memmove()
+
+/*
+ * Same default as in cobs.cpp: scan for special bytes and copy the runs
+ * between them in bulk on hosted platforms, byte by byte on Arduino.
+ */
+#ifndef COBS_BULK_COPY
+#if defined(ARDUINO)
+#define COBS_BULK_COPY 0
+#else
+#define COBS_BULK_COPY 1
+#endif
+#endif
+
+#if COBS_BULK_COPY && defined(__SSE2__)
+#define COBS_ESCAPE_SSE2 1
+#include <emmintrin.h>
+#else
+#define COBS_ESCAPE_SSE2 0
+#endif
+
+#if COBS_ESCAPE_SSE2
+// Index of the lowest set bit, mask must not be 0.
+static inline unsigned lowestBit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+    unsigned i = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+#endif
+
+// Special bytes of an escape-based framing scheme.
+struct EscapeScheme {
+    uint8_t end;      // frame delimiter
+    uint8_t esc;      // escape byte
+    uint8_t esc_end;  // follows esc for a data byte equal to end
+    uint8_t esc_esc;  // follows esc for a data byte equal to esc
+    uint8_t esc_xor;  // if not 0, any byte after esc is XORed with it
+};
+
+// SLIP only knows its two escape sequences. HDLC (RFC 1662, 4.2) 
+// un-escapes any byte, so frames from peers which also escape control
+// characters are accepted.
+static const EscapeScheme SLIP_SCHEME = {0xC0, 0xDB, 0xDC, 0xDD, 0x00};
+static const EscapeScheme HDLC_SCHEME = {0x7E, 0x7D, 0x5E, 0x5D, 0x20};
+
+#if COBS_BULK_COPY
+
+// Return position of first byte equal to a or b in buf, len if there is none.
+static inline size_t findEither(const uint8_t *buf, size_t len, uint8_t a, uint8_t b) {
+    size_t i = 0;
+#if COBS_ESCAPE_SSE2
+    const __m128i va = _mm_set1_epi8(static_cast<char>(a));
+    const __m128i vb = _mm_set1_epi8(static_cast<char>(b));
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask != 0) return i + lowestBit(static_cast<unsigned>(mask));
+    }
+#endif
+    for (; i < len; i++) {
+        if (buf[i] == a || buf[i] == b) return i;
+    }
+    return len;
+}
+
+#endif // COBS_BULK_COPY
+
+static size_t encodeEscaped(const EscapeScheme &scheme, const uint8_t *inptr, size_t inputlen, 
+                            uint8_t *outptr, size_t outlen, bool add_end) {
+    if (outlen < 2 * inputlen + (add_end ? 1 : 0)) {
+        return 0;
+    }
+    const uint8_t *end = inptr + inputlen;
+    uint8_t *out = outptr;
+    while (inptr < end) {
+#if COBS_BULK_COPY
+        const size_t run = findEither(inptr, static_cast<size_t>(end - inptr), scheme.end, scheme.esc);
+        if (run > 0) memcpy(out, inptr, run);
+        out += run;
+        inptr += run;
+        if (inptr == end) break;
+#endif
+        const uint8_t b = *inptr++;
+        if (b == scheme.end) {
+            *out++ = scheme.esc;
+            *out++ = scheme.esc_end;
+        }
+        else if (b == scheme.esc) {
+            *out++ = scheme.esc;
+            *out++ = scheme.esc_esc;
+        }
+        else {
+            *out++ = b;
+        }
+    }
+    if (add_end) *out++ = scheme.end;
+    return static_cast<size_t>(out - outptr);
+}
+
+static size_t decodeEscaped(const EscapeScheme &scheme, const uint8_t *inptr, size_t inputlen,
+                            uint8_t *outptr, size_t outputlen) {
+    // the frame ends at the first delimiter
+    const uint8_t *delimiter = static_cast<const uint8_t *>(memchr(inptr, scheme.end, inputlen));
+    if (delimiter != NULL) inputlen = static_cast<size_t>(delimiter - inptr);
+    if (inputlen == 0 || outputlen < inputlen) {
+        return 0;
+    }
+    const uint8_t *end = inptr + inputlen;
+    uint8_t *out = outptr;
+    while (inptr < end) {
+#if COBS_BULK_COPY
+        const uint8_t *esc = static_cast<const uint8_t *>(memchr(inptr, scheme.esc, static_cast<size_t>(end - inptr)));
+        const size_t run = (esc == NULL) ? static_cast<size_t>(end - inptr) : static_cast<size_t>(esc - inptr);
+        // memmove() because decoding may be done in-place
+        if (run > 0) memmove(out, inptr, run);
+        out += run;
+        inptr += run;
+        if (inptr == end) break;
+#endif
+        const uint8_t b = *inptr++;
+        if (b != scheme.esc) {
+            *out++ = b;
+            continue;
+        }
+        // escape byte must be followed by one of the escaped values
+        if (inptr == end) return 0;
+        const uint8_t e = *inptr++;
+        if (scheme.esc_xor != 0) {
+            *out++ = e ^ scheme.esc_xor;
+        }
+        else if (e == scheme.esc_end) {
+            *out++ = scheme.end;
+        }
+        else if (e == scheme.esc_esc) {
+            *out++ = scheme.esc;
+        }
+        else {
+            return 0;
+        }
+    }
+    return static_cast<size_t>(out - outptr);
+}
+
+/**
+ * @brief  Encode a buffer of bytes with SLIP (RFC 1055).
+ * @param  inptr 
+ *         pointer to buffer with bytes to encode
+ * @param  inputlen
+ *         number of bytes to take from input buffer to encode
+ * @param  outptr
+ *         pointer to buffer to write encoded bytes to
+ * @param  outlen
+ *         the maximum size of the output buffer, at least 
+ *         getSLIPBufferSize(inputlen, add_end)
+ * @param  add_end 
+ *         when this is true, the END byte (0xC0) is appended
+ * @return Number of bytes written to buffer outptr. 
+ *         If output buffer may be to small, return 0.
+ */
+size_t encodeSLIP(const uint8_t *inptr, size_t inputlen, uint8_t *outptr, size_t outlen, bool add_end) {
+    return encodeEscaped(SLIP_SCHEME, inptr, inputlen, outptr, outlen, add_end);
+}
+
+/**
+ * @brief  Decode a SLIP encoded frame.
+ * @param  inptr 
+ *         Pointer to buffer with SLIP encoded bytes. The frame ends at 
+ *         the first END byte or at the end of the buffer.
+ * @param  inputlen
+ *         Number of bytes in input buffer.
+ * @param  outptr
+ *         Pointer to buffer into which to write the decoded bytes.
+ *         This may be the same as inptr (in-place decoding).
+ * @param  outputlen
+ *         Maximum number of bytes the output buffer can hold. Must be
+ *         at least the length of the encoded frame (without END).
+ * @return Number of bytes written to outptr. 
+ *         A number of 0 written bytes signals an error condition
+ *         (empty frame, invalid escape sequence, output buffer too small).
+ * @note   Many senders start each frame with an END byte as well. The
+ *         resulting empty frames are reported as 0 and can be skipped.
+ */
+size_t decodeSLIP(const uint8_t *inptr, size_t inputlen, uint8_t *outptr, size_t outputlen) {
+    return decodeEscaped(SLIP_SCHEME, inptr, inputlen, outptr, outputlen);
+}
+
+/**
+ * @brief  Encode a buffer of bytes with HDLC-like byte stuffing 
+ *         (RFC 1662). Only the flag and the escape byte are escaped.
+ * @param  inptr 
+ *         pointer to buffer with bytes to encode
+ * @param  inputlen
+ *         number of bytes to take from input buffer to encode
+ * @param  outptr
+ *         pointer to buffer to write encoded bytes to
+ * @param  outlen
+ *         the maximum size of the output buffer, at least
+ *         getHDLCBufferSize(inputlen, add_flag)
+ * @param  add_flag 
+ *         when this is true, the flag byte (0x7E) is appended
+ * @return Number of bytes written to buffer outptr. 
+ *         If output buffer may be to small, return 0.
+ */
+size_t encodeHDLC(const uint8_t *inptr, size_t inputlen, uint8_t *outptr, size_t outlen, bool add_flag) {
+    return encodeEscaped(HDLC_SCHEME, inptr, inputlen, outptr, outlen, add_flag);
+}
+
+/**
+ * @brief  Decode an HDLC-like byte stuffed frame. Same as decodeSLIP(),
+ *         with flag 0x7E and escape byte 0x7D. As in RFC 1662, the byte
+ *         after an escape byte is XORed with 0x20, whatever its value.
+ *         Escaped control characters are decoded as well.
+ * @return Number of bytes written to outptr. 
+ *         A number of 0 written bytes signals an error condition.
+ */
+size_t decodeHDLC(const uint8_t *inptr, size_t inputlen, uint8_t *outptr, size_t outputlen) {
+    return decodeEscaped(HDLC_SCHEME, inptr, inputlen, outptr, outputlen);
+}
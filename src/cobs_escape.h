@@ -0,0 +1,80 @@
+/**
+ * @file    cobs_escape.h
+ * @brief   SLIP and HDLC byte stuffing with the same API as the COBS functions.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_escape_h
+#define ConsistentOverheadByteStuffing_escape_h
+
+/*
+ * Escape-based framing for devices which do not speak COBS:
+ * - SLIP (RFC 1055): END 0xC0, ESC 0xDB; 0xC0 -> 0xDB 0xDC, 0xDB -> 0xDB 0xDD
+ * - HDLC-like (RFC 1662, async): flag 0x7E, escape 0x7D; 0x7E -> 0x7D 0x5E,
+ *   0x7D -> 0x7D 0x5D. Control characters are not escaped and no FCS is added.
+ *   When decoding, any escaped byte is accepted (XOR 0x20).
+ * Buffer contracts are the same as for encodeCOBS() and decodeCOBS().
+ */
+#include <stddef.h>  // needed for size_t data type
+#include <stdint.h>  // needed for uint8_t data type
+
+/*
+ * Worst case: every byte is escaped.
+ */
+constexpr size_t getSLIPBufferSize(size_t input_size,
+                                   bool   with_end=true) {
+    return 2 * input_size + (with_end ? 1 : 0);
+}
+
+constexpr size_t getHDLCBufferSize(size_t input_size,
+                                   bool   with_flag=true) {
+    return 2 * input_size + (with_flag ? 1 : 0);
+}
+
+size_t encodeSLIP(const uint8_t *inptr,
+                  size_t inputlen,
+                  uint8_t *outptr,
+                  size_t outlen,
+                  bool add_end=true);
+
+size_t decodeSLIP(const uint8_t *inptr,
+                  size_t inputlen,
+                  uint8_t *outptr,
+                  size_t outputlen);
+
+size_t encodeHDLC(const uint8_t *inptr,
+                  size_t inputlen,
+                  uint8_t *outptr,
+                  size_t outlen,
+                  bool add_flag=true);
+
+size_t decodeHDLC(const uint8_t *inptr,
+                  size_t inputlen,
+                  uint8_t *outptr,
+                  size_t outputlen);
+
+#endif
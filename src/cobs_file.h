@@ -0,0 +1,254 @@
+/**
+ * @file    cobs_file.h
+ * @brief   Read COBS framed log files backwards and follow them while they grow.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_file_h
+#define ConsistentOverheadByteStuffing_file_h
+
+/*
+ * The file type is a template parameter, just like the stream type in
+ * cobs_stream.h. Any class works which provides these methods (like the
+ * File class of Arduino's SD library does):
+ *   size_t size();
+ *   bool   seek(size_t pos);
+ *   int    read(uint8_t *buffer, size_t length);
+ */
+#include "cobs.h"
+#include "cobs_stream.h"
+
+// Read exactly len bytes from position pos of file.
+template <class FileType>
+bool readCOBSFileAt(FileType &file, size_t pos, uint8_t *buffer, size_t len) {
+    if (!file.seek(pos)) return false;
+    while (len > 0) {
+        int n = file.read(buffer, len);
+        if (n <= 0) return false;
+        buffer += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief  Find the last zero byte in a file before a given position.
+ *         The file is read backwards in blocks of bufferlen bytes.
+ * @param  file
+ *         file to search
+ * @param  end
+ *         search bytes before this position
+ * @param  buffer
+ *         buffer for reading blocks of the file
+ * @param  bufferlen
+ *         size of buffer
+ * @return Position of the last zero byte before end. If there is no zero
+ *         byte (or the file cannot be read), return end.
+ */
+template <class FileType>
+size_t findLastCOBSDelimiter(FileType &file, size_t end, uint8_t *buffer, size_t bufferlen) {
+    size_t pos = end;
+    while (pos > 0 && bufferlen > 0) {
+        size_t len = (pos < bufferlen) ? pos : bufferlen;
+        pos -= len;
+        if (!readCOBSFileAt(file, pos, buffer, len)) return end;
+        size_t zero = findCOBSDelimiterReverse(buffer, len);
+        if (zero < len) return pos + zero;
+    }
+    return end;
+}
+
+/**
+ * @brief  Read the frames of a COBS framed file backwards, starting with
+ *         the newest one. Only the last frames are read, so the cost does
+ *         not depend on the size of the file. An incomplete frame at the
+ *         end of the file (not yet terminated by a zero byte) is ignored.
+ */
+template <class FileType>
+class COBSReverseReader {
+  public:
+    /**
+     * @param  file
+     *         file to read encoded frames from
+     * @param  buffer
+     *         buffer for reading blocks of the file and decoding frames
+     * @param  bufferlen
+     *         Size of buffer. Frames with more than bufferlen-1 encoded 
+     *         bytes are dropped (except for the first frame of the file).
+     */
+    COBSReverseReader(FileType &file, uint8_t *buffer, size_t bufferlen)
+        : _file(file), _buffer(buffer), _bufferlen(bufferlen), _frame(buffer),
+          _end(0), _win_start(0), _win_len(0), _dropped(0), _started(false) {}
+
+    /**
+     * @brief  Decode the frame in front of the frame returned by the last
+     *         call. The first call returns the last complete frame of the file.
+     * @return Length of the decoded frame, 0 if there are no more frames.
+     *         The decoded frame can be accessed with frame() and is valid
+     *         until the next call to previous(). Empty and invalid frames
+     *         are skipped.
+     */
+    size_t previous() {
+        if (!_started) {
+            _started = true;
+            const size_t size = _file.size();
+            const size_t last = findLastCOBSDelimiter(_file, size, _buffer, _bufferlen);
+            _end = (last == size) ? 0 : last;
+            _win_start = _end;
+        }
+        // The window buffer[0.._win_len) holds file bytes from _win_start
+        // up to _end, the delimiter after the next frame to return.
+        while (_end > 0) {
+            size_t zero = findCOBSDelimiterReverse(_buffer, _win_len);
+            size_t start;
+            if (zero < _win_len) {
+                start = zero + 1;
+            }
+            else if (_win_start == 0) {
+                // first frame of the file
+                zero = 0;
+                start = 0;
+            }
+            else if (_win_len < _bufferlen) {
+                // read a larger window and try again
+                _win_len = (_end < _bufferlen) ? _end : _bufferlen;
+                _win_start = _end - _win_len;
+                if (!readCOBSFileAt(_file, _win_start, _buffer, _win_len)) {
+                    _end = _win_start = _win_len = 0;
+                }
+                continue;
+            }
+            else {
+                // frame does not fit into buffer
+                _dropped++;
+                const size_t last = findLastCOBSDelimiter(_file, _win_start, _buffer, _bufferlen);
+                _end = (last == _win_start) ? 0 : last;
+                _win_start = _end;
+                _win_len = 0;
+                continue;
+            }
+            // Decoding in place only changes the bytes of this frame.
+            // The bytes in front of it stay valid for the next call.
+            const size_t encoded_len = _win_len - start;
+            _frame = _buffer + start;
+            _end = _win_start + zero;
+            _win_len = zero;
+            size_t len = (encoded_len > 0) ? decodeCOBS_inplace(_frame, encoded_len) : 0;
+            if (len > 0) return len;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief  Get the last frame returned by previous().
+     * @return pointer to the decoded bytes
+     */
+    const uint8_t *frame() const {
+        return _frame;
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they were too long.
+     * @return number of dropped frames
+     */
+    size_t dropped() const {
+        return _dropped;
+    }
+
+  private:
+    FileType &_file;
+    uint8_t  *_buffer;
+    size_t    _bufferlen;
+    uint8_t  *_frame;
+    size_t    _end;        // position of delimiter after next frame
+    size_t    _win_start;  // file position of buffer[0]
+    size_t    _win_len;    // valid bytes in buffer
+    size_t    _dropped;
+    bool      _started;
+};
+
+/**
+ * @brief  Present a file which is still growing as a stream. Use it with
+ *         COBSStreamReader to decode frames as they are appended to the 
+ *         file. available() checks the file size on each call, so calling
+ *         COBSStreamReader::read() periodically follows the file.
+ */
+template <class FileType>
+class COBSFileStream {
+  public:
+    /**
+     * @param  file
+     *         file to read from
+     * @param  position
+     *         position in the file to start reading from
+     */
+    COBSFileStream(FileType &file, size_t position=0) : _file(file), _pos(position) {}
+
+    /**
+     * @brief  Skip all complete frames which are already in the file.
+     *         Reading continues with the start of the incomplete frame at
+     *         the end of the file (if any).
+     * @param  buffer
+     *         buffer for searching the file backwards
+     * @param  bufferlen
+     *         size of buffer
+     */
+    void skipExisting(uint8_t *buffer, size_t bufferlen) {
+        const size_t size = _file.size();
+        const size_t last = findLastCOBSDelimiter(_file, size, buffer, bufferlen);
+        _pos = (last == size) ? 0 : last + 1;
+    }
+
+    int available() {
+        const size_t size = _file.size();
+        if (size <= _pos) return 0;
+        // int may only have 16 bits
+        return (size - _pos < 0x7FFF) ? static_cast<int>(size - _pos) : 0x7FFF;
+    }
+
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        if (!_file.seek(_pos)) return 0;
+        int n = _file.read(buffer, length);
+        if (n <= 0) return 0;
+        _pos += static_cast<size_t>(n);
+        return static_cast<size_t>(n);
+    }
+
+    /**
+     * @brief  Get the position of the next byte to read.
+     * @return position in the file
+     */
+    size_t position() const {
+        return _pos;
+    }
+
+  private:
+    FileType &_file;
+    size_t    _pos;
+};
+
+#endif
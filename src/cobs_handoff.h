@@ -0,0 +1,308 @@
+/**
+ * @file    cobs_handoff.h
+ * @brief   Hand-off of decoded frames between threads, with batched wakeups.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_handoff_h
+#define ConsistentOverheadByteStuffing_handoff_h
+
+/*
+ * Waking up a thread costs a system call and a context switch, which 
+ * takes longer than decoding a small frame. COBSFrameHandoff passes 
+ * frames from a reader thread to a consumer thread and wakes the 
+ * consumer once per batch of frames. Before going to sleep, the consumer
+ * spins for a while. Batch size and spin count follow the arrival rate.
+ *
+ * Needs C++11 threads (PC, ESP32). Not included by the other headers.
+ */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include "cobs.h"
+
+/**
+ * @brief  Single producer, single consumer queue of decoded frames.
+ * @tparam MaxFrameSize
+ *         maximum length of a frame
+ * @tparam Slots
+ *         number of frames the queue can hold
+ */
+template <size_t MaxFrameSize, size_t Slots>
+class COBSFrameHandoff {
+    static_assert(MaxFrameSize > 0, "MaxFrameSize must not be 0");
+    static_assert(Slots > 1, "Slots must be at least 2");
+  public:
+    /**
+     * @brief  Constructor.
+     * @param  max_latency_us
+     *         longest time a frame waits for the batch to fill up
+     * @param  max_spin
+     *         maximum number of polls before the consumer goes to sleep
+     */
+    explicit COBSFrameHandoff(uint32_t max_latency_us=1000, uint32_t max_spin=4096)
+        : _head(0), _tail(0), _sleeping(false), _target(1), _closed(false),
+          _frames(0), _wakeups(0), _dropped(0), _batch(1), _spin(0),
+          _max_spin(max_spin), _latency(max_latency_us), _interval_ns(0),
+          _last(std::chrono::steady_clock::now()) {}
+
+    /**
+     * @brief  Producer: get the buffer for the next frame, e.g. to 
+     *         decode into it directly. Call commit() when done.
+     * @return buffer of MaxFrameSize bytes, NULL if the queue is full
+     */
+    uint8_t *acquire() {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= Slots) return 0;
+        return _buffers[head % Slots];
+    }
+
+    /**
+     * @brief  Producer: pass the frame in the buffer from acquire() on.
+     *         Wakes the consumer if a batch is complete.
+     * @param  len
+     *         length of the frame
+     */
+    void commit(size_t len) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        _lengths[head % Slots] = len;
+        _head.store(head + 1, std::memory_order_seq_cst);
+        if (_sleeping.load(std::memory_order_seq_cst)
+            && head + 1 - _tail.load(std::memory_order_acquire) >= _target.load(std::memory_order_relaxed)
+            && _sleeping.exchange(false)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _wakeup.notify_one();
+        }
+    }
+
+    /**
+     * @brief  Producer: copy a frame into the queue.
+     * @return false if the frame was dropped (too long or queue full)
+     */
+    bool push(const uint8_t *frame, size_t len) {
+        uint8_t *buf = (len <= MaxFrameSize) ? acquire() : 0;
+        if (buf == 0) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (len > 0) memcpy(buf, frame, len);
+        commit(len);
+        return true;
+    }
+
+    /**
+     * @brief  Producer: no more frames follow. wait() returns 0 once the
+     *         queue is empty.
+     */
+    void close() {
+        _closed.store(true);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _wakeup.notify_one();
+    }
+
+    /**
+     * @brief  Consumer: wait for frames. Returns at once if frames are 
+     *         queued, otherwise spins and then sleeps until a batch is 
+     *         complete or max_latency_us has passed.
+     * @return number of frames which can be accessed with frame(), 
+     *         0 if the queue was closed
+     * @note   Call release() when done with the frames.
+     */
+    size_t wait() {
+        size_t n = available();
+        if (n == 0) n = spin();
+        bool idle = false;
+        while (n == 0) {
+            if (_closed.load()) return available();
+            std::unique_lock<std::mutex> lock(_mutex);
+            // while idle, sleep until the first frame arrives
+            const size_t target = idle ? 1 : _batch;
+            _target.store(target, std::memory_order_relaxed);
+            _sleeping.store(true, std::memory_order_seq_cst);
+            if (idle) {
+                _wakeup.wait(lock, [&]() { return (queued() > 0) || _closed.load(); });
+            }
+            else {
+                _wakeup.wait_for(lock, std::chrono::microseconds(_latency),
+                                 [&]() { return (queued() >= target) || _closed.load(); });
+            }
+            _sleeping.store(false);
+            _wakeups.fetch_add(1, std::memory_order_relaxed);
+            n = available();
+            idle = true;
+        }
+        adapt(n);
+        return n;
+    }
+
+    /**
+     * @brief  Consumer: access a frame returned by wait().
+     * @param  index
+     *         0 for the oldest frame
+     * @param  len
+     *         the length of the frame is stored here
+     * @return pointer to the frame
+     */
+    const uint8_t *frame(size_t index, size_t *len) const {
+        const size_t slot = (_tail.load(std::memory_order_relaxed) + index) % Slots;
+        *len = _lengths[slot];
+        return _buffers[slot];
+    }
+
+    /**
+     * @brief  Consumer: free the oldest frames for the producer.
+     * @param  count
+     *         number of frames, at most the value returned by wait()
+     */
+    void release(size_t count) {
+        _tail.store(_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+        _frames.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief  Get the number of frames in the queue.
+     * @return number of frames
+     */
+    size_t available() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief  Get the number of frames the consumer released so far.
+     * @return number of frames
+     */
+    size_t frames() const {
+        return _frames.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief  Get the number of times the consumer was woken up.
+     * @return number of wakeups
+     */
+    size_t wakeups() const {
+        return _wakeups.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief  Get the number of wakeups per frame. Without batching, 
+     *         this is 1 when the consumer keeps up with the producer.
+     * @return wakeups per released frame, 0 if no frame was released
+     */
+    double wakeupsPerFrame() const {
+        const size_t count = frames();
+        return (count == 0) ? 0.0 : static_cast<double>(wakeups()) / static_cast<double>(count);
+    }
+
+    /**
+     * @brief  Get the number of frames dropped by push().
+     * @return number of frames
+     */
+    size_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief  Get the current batch size (consumer thread only).
+     * @return number of frames the consumer waits for
+     */
+    size_t batchSize() const {
+        return _batch;
+    }
+
+    /**
+     * @brief  Get the current spin count (consumer thread only).
+     * @return number of polls before the consumer goes to sleep
+     */
+    uint32_t spinCount() const {
+        return _spin;
+    }
+
+  private:
+    // Same as available(), but orders the load of _head after the store
+    // to _sleeping. commit() stores _head and then loads _sleeping, so 
+    // either the producer sees the sleeper or the consumer sees the frame.
+    size_t queued() const {
+        return _head.load(std::memory_order_seq_cst) - _tail.load(std::memory_order_relaxed);
+    }
+
+    // Poll for frames before going to sleep. Spin longer next time if 
+    // this was worth it, shorter if not.
+    size_t spin() {
+        size_t n = 0;
+        for (uint32_t i=0; i<_spin && n == 0; i++) {
+            n = available();
+        }
+        if (n > 0) {
+            _spin = (_spin >= _max_spin / 2) ? _max_spin : ((_spin < 8) ? 16 : 2 * _spin);
+        }
+        else {
+            _spin = (_spin < 16) ? 16 : _spin / 2;
+            if (_spin > _max_spin) _spin = _max_spin;
+        }
+        return n;
+    }
+
+    // Update the mean time between frames and the number of frames 
+    // which arrive within the latency limit.
+    void adapt(size_t n) {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const uint64_t elapsed = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count());
+        _last = now;
+        const uint64_t interval = elapsed / n;
+        _interval_ns = (_interval_ns == 0) ? interval : (7 * _interval_ns + interval) / 8;
+        uint64_t batch = (_interval_ns == 0) ? Slots : 1000u * static_cast<uint64_t>(_latency) / _interval_ns;
+        if (batch > Slots / 2) batch = Slots / 2;
+        _batch = (batch < 1) ? 1 : static_cast<size_t>(batch);
+    }
+
+    // shared by producer and consumer
+    std::atomic<size_t>       _head;      // frames committed
+    std::atomic<size_t>       _tail;      // frames released
+    std::atomic<bool>         _sleeping;  // consumer waits for _wakeup
+    std::atomic<size_t>       _target;    // frames to queue before waking the consumer
+    std::atomic<bool>         _closed;
+    std::atomic<size_t>       _frames;
+    std::atomic<size_t>       _wakeups;
+    std::atomic<size_t>       _dropped;
+    std::mutex                _mutex;
+    std::condition_variable   _wakeup;
+    // consumer only
+    size_t                    _batch;
+    uint32_t                  _spin;
+    const uint32_t            _max_spin;
+    const uint32_t            _latency;     // microseconds
+    uint64_t                  _interval_ns; // mean time between frames
+    std::chrono::steady_clock::time_point _last;
+    // frames
+    size_t                    _lengths[Slots];
+    uint8_t                   _buffers[Slots][MaxFrameSize];
+};
+
+#endif
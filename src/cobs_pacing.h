@@ -0,0 +1,213 @@
+/**
+ * @file    cobs_pacing.h
+ * @brief   Write COBS frames at the line rate, urgent frames first.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_pacing_h
+#define ConsistentOverheadByteStuffing_pacing_h
+
+/*
+ * Writing frames as fast as possible fills the transmit buffer of the
+ * driver, and an urgent frame has to wait until everything in front of
+ * it is sent. COBSPacedWriter keeps only a small backlog in the driver
+ * and holds the other frames in its own queues, ordered by priority.
+ *
+ * The backlog is estimated from the bytes written and the time passed
+ * at the configured baud rate. The stream type is a template parameter,
+ * see cobs_stream.h. It needs these methods:
+ *   int    availableForWrite();
+ *   size_t write(const uint8_t *buffer, size_t size);
+ */
+#include "cobs.h"
+#include "cobs_broadcast.h"
+
+/**
+ * @brief  Paced writer for shared frames with priority queues.
+ * @tparam StreamType
+ *         type of the stream
+ * @tparam N
+ *         maximum number of queued frames per priority
+ * @tparam Priorities
+ *         number of priorities, 0 is the most urgent one
+ */
+template <class StreamType, size_t N, uint8_t Priorities=2>
+class COBSPacedWriter {
+  public:
+    /**
+     * @param  stream
+     *         stream to write to
+     * @param  baudrate
+     *         baud rate of the line
+     * @param  target_backlog
+     *         maximum number of bytes waiting in the driver
+     * @param  bits_per_byte
+     *         bits on the line per byte, 10 for 8N1
+     */
+    COBSPacedWriter(StreamType &stream, uint32_t baudrate, size_t target_backlog, uint8_t bits_per_byte=10)
+        : _stream(stream), _baudrate(baudrate), _target(target_backlog), _bits_per_byte(bits_per_byte),
+          _backlog(0), _carry(0), _last_us(0), _current(0), _offset(0) {
+        for (uint8_t p=0; p<Priorities; p++) {
+            _head[p] = 0;
+            _count[p] = 0;
+        }
+    }
+
+    ~COBSPacedWriter() {
+        clear();
+    }
+
+    /**
+     * @brief  Put a frame on the queue of the given priority. The writer
+     *         takes a reference to the frame.
+     * @return false if the queue is full or the priority is invalid
+     */
+    bool push(COBSSharedFrame *frame, uint8_t priority=0) {
+        if (priority >= Priorities || _count[priority] == N) return false;
+        frame->retain();
+        _frames[priority][(_head[priority] + _count[priority]) % N] = frame;
+        _count[priority]++;
+        return true;
+    }
+
+    /**
+     * @brief  Write queued frames as far as the backlog allows. Call this
+     *         regularly, e.g. from loop().
+     * @param  now_us
+     *         current time in microseconds (like micros() on Arduino),
+     *         may wrap around
+     * @return number of bytes written
+     * @note   A frame which has been started is always finished before 
+     *         another one, so urgent frames wait for at most one frame.
+     */
+    size_t poll(uint32_t now_us) {
+        drain(now_us);
+        size_t total = 0;
+        while (_offset > 0 || select()) {
+            size_t room = (_backlog < _target) ? _target - _backlog : 0;
+            const int writable = _stream.availableForWrite();
+            if (writable <= 0) break;
+            if (static_cast<size_t>(writable) < room) room = static_cast<size_t>(writable);
+            if (room == 0) break;
+            COBSSharedFrame *frame = _frames[_current][_head[_current]];
+            size_t len = frame->length() - _offset;
+            if (len > room) len = room;
+            const size_t n = _stream.write(frame->data() + _offset, len);
+            _backlog += n;
+            total += n;
+            _offset += n;
+            if (_offset < frame->length()) {
+                if (n < len) break;
+                continue;
+            }
+            pop(_current);
+        }
+        return total;
+    }
+
+    /**
+     * @brief  Drop all queued frames. A frame which has been started is
+     *         dropped as well, the receiver will discard it.
+     */
+    void clear() {
+        for (uint8_t p=0; p<Priorities; p++) {
+            while (_count[p] > 0) pop(p);
+        }
+    }
+
+    /**
+     * @brief  Get the number of queued frames of all priorities.
+     * @return number of queued frames
+     */
+    size_t queued() const {
+        size_t count = 0;
+        for (uint8_t p=0; p<Priorities; p++) count += _count[p];
+        return count;
+    }
+
+    /**
+     * @brief  Get the estimated number of bytes waiting in the driver.
+     * @return backlog in bytes
+     */
+    size_t backlog() const {
+        return _backlog;
+    }
+
+  private:
+    // reduce the backlog by the bytes sent since the last call
+    void drain(uint32_t now_us) {
+        const uint32_t elapsed = now_us - _last_us;
+        _last_us = now_us;
+        if (_backlog == 0) return;
+        // bit-microseconds sent, one byte takes bits_per_byte * 1000000 of them
+        const uint64_t sent = static_cast<uint64_t>(elapsed) * _baudrate + _carry;
+        const uint64_t per_byte = static_cast<uint64_t>(_bits_per_byte) * 1000000u;
+        const uint64_t bytes = sent / per_byte;
+        if (bytes >= _backlog) {
+            _backlog = 0;
+            _carry = 0;
+        }
+        else {
+            _backlog -= static_cast<size_t>(bytes);
+            _carry = static_cast<uint32_t>(sent % per_byte);
+        }
+    }
+
+    // choose the most urgent queue with a frame
+    bool select() {
+        for (uint8_t p=0; p<Priorities; p++) {
+            if (_count[p] > 0) {
+                _current = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void pop(uint8_t priority) {
+        COBSSharedFrame *frame = _frames[priority][_head[priority]];
+        _head[priority] = (_head[priority] + 1) % N;
+        _count[priority]--;
+        if (priority == _current) _offset = 0;
+        frame->release();
+    }
+
+    StreamType      &_stream;
+    uint32_t         _baudrate;
+    size_t           _target;
+    uint8_t          _bits_per_byte;
+    size_t           _backlog;   // estimated bytes in the driver
+    uint32_t         _carry;     // bit-microseconds not yet counted as a byte
+    uint32_t         _last_us;
+    COBSSharedFrame *_frames[Priorities][N];
+    size_t           _head[Priorities];
+    size_t           _count[Priorities];
+    uint8_t          _current;   // queue of the frame being written
+    size_t           _offset;    // bytes of the current frame already written
+};
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file    cobs_priority.h
+ * @brief   Receive COBS frames with a fast lane for control frames.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_priority_h
+#define ConsistentOverheadByteStuffing_priority_h
+
+/*
+ * As soon as the delimiter of a frame is received, the first HeaderSize
+ * bytes are decoded and a function provided by the application decides
+ * if it is a control frame. Control frames are decoded at once into a 
+ * buffer of their own and can be read before all bulk frames. Bulk 
+ * frames stay encoded until the application has time for them. The 
+ * stream type is a template parameter, see cobs_stream.h. It needs these
+ * methods:
+ *   int    available();
+ *   size_t readBytes(uint8_t *buffer, size_t length);
+ */
+#include <string.h>  // needed for memmove()
+#include "cobs.h"
+#include "cobs_queue.h"
+
+/*
+ * Return true if the frame starting with the given (decoded) header 
+ * bytes is a control frame. len is less than HeaderSize for short frames.
+ */
+typedef bool (*COBSClassifyFunction)(const uint8_t *header, size_t len, void *context);
+
+/**
+ * @brief  Receive queue for COBS encoded frames with a fast lane for 
+ *         control frames.
+ * @tparam StreamType
+ *         type of the stream
+ * @tparam MaxFrames
+ *         maximum number of bulk frames waiting to be read
+ * @tparam MaxControlFrames
+ *         maximum number of control frames waiting to be read
+ * @tparam HeaderSize
+ *         number of bytes passed to the classify function
+ */
+template <class StreamType, size_t MaxFrames, size_t MaxControlFrames=4, size_t HeaderSize=1>
+class COBSPriorityReader {
+    static_assert(MaxControlFrames > 0, "MaxControlFrames must not be 0");
+    static_assert(HeaderSize > 0, "HeaderSize must not be 0");
+  public:
+    /**
+     * @param  stream
+     *         stream to read encoded frames from
+     * @param  buffer
+     *         Buffer for received frames. Its size is the maximum length 
+     *         of an encoded frame including its delimiter. Longer frames
+     *         are dropped.
+     * @param  bufferlen
+     *         size of buffer
+     * @param  control
+     *         buffer for decoded control frames
+     * @param  controllen
+     *         Size of control. Control frames which do not fit (even if 
+     *         no other control frame is waiting) are read as bulk frames.
+     * @param  classify
+     *         function which tells control frames from bulk frames
+     * @param  context
+     *         passed to classify
+     */
+    COBSPriorityReader(StreamType &stream, uint8_t *buffer, size_t bufferlen,
+                       uint8_t *control, size_t controllen,
+                       COBSClassifyFunction classify, void *context=0)
+        : _stream(stream), _queue(buffer, bufferlen),
+          _control(control), _controllen(controllen),
+          _classify(classify), _context(context), _frame(buffer),
+          _control_used(0), _control_count(0), _control_ready(false) {}
+
+    /**
+     * @brief  Read all available bytes from the stream (but do not wait
+     *         for more) and classify the frames completed by them. 
+     *         Control frames are decoded at once. Bytes which do not fit 
+     *         into the buffer are left in the stream.
+     * @return number of control frames waiting to be read
+     * @note   When the buffer is full of bulk frames, control frames 
+     *         behind them cannot be received. Make the buffer large 
+     *         enough for the expected backlog of bulk frames.
+     */
+    size_t receive() {
+        while (scan() && _queue.receive(_stream) > 0) {}
+        return _control_count;
+    }
+
+    /**
+     * @brief  Get the oldest control frame.
+     * @return Length of the decoded frame, 0 if no control frame is 
+     *         waiting. The frame can be accessed with frame() and is 
+     *         valid until the next call to readControl().
+     */
+    size_t readControl() {
+        if (_control_ready) {
+            // remove the frame returned last time
+            const size_t len = _control_lengths[0];
+            memmove(_control, _control + len, _control_used - len);
+            memmove(_control_lengths, _control_lengths + 1, (_control_count - 1) * sizeof(_control_lengths[0]));
+            _control_used -= len;
+            _control_count--;
+            _control_ready = false;
+            scan();
+        }
+        if (_control_count == 0) return 0;
+        _control_ready = true;
+        _frame = _control;
+        return _control_lengths[0];
+    }
+
+    /**
+     * @brief  Decode the oldest bulk frame.
+     * @return Length of the decoded frame, 0 if no bulk frame is waiting.
+     *         The frame can be accessed with frame() and is valid until
+     *         the next call to readBulk() or receive().
+     */
+    size_t readBulk() {
+        while (_queue.count() > 0) {
+            size_t len;
+            uint8_t *frame = _queue.front(&len);
+            _queue.pop();
+            const size_t decoded = decodeCOBS_inplace(frame, len);
+            if (decoded > 0) {
+                _frame = frame;
+                return decoded;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief  Get the last frame returned by readControl() or readBulk().
+     * @return pointer to the decoded bytes
+     */
+    const uint8_t *frame() const {
+        return _frame;
+    }
+
+    /**
+     * @brief  Get the number of bulk frames waiting to be read.
+     * @return number of frames
+     */
+    size_t bulkFrames() const {
+        return _queue.count();
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they were too long.
+     * @return number of dropped frames
+     */
+    size_t dropped() const {
+        return _queue.dropped();
+    }
+
+  private:
+    // Find delimiters in the received bytes and classify the frames.
+    // Return false if a queue is full.
+    bool scan() {
+        uint8_t *encoded;
+        size_t len;
+        while (_queue.next(&encoded, &len)) {
+            uint8_t header[HeaderSize];
+            const size_t header_len = decodeCOBS_prefix(encoded, len, header, HeaderSize);
+            if (_classify != 0 && _classify(header, header_len, _context) && len - 1 <= _controllen) {
+                // control frame: decoded length is less than len
+                if (_control_count == MaxControlFrames || _control_used + len - 1 > _controllen) return false;
+                const size_t decoded = decodeCOBS(encoded, len, _control + _control_used, _controllen - _control_used);
+                if (decoded > 0) {
+                    _control_lengths[_control_count++] = decoded;
+                    _control_used += decoded;
+                }
+                _queue.discard();
+                continue;
+            }
+            if (_queue.full()) return false;
+            _queue.push();
+        }
+        return true;
+    }
+
+    StreamType               &_stream;
+    COBSFrameQueue<MaxFrames> _queue;                              // bulk frames, still encoded
+    uint8_t                  *_control;
+    size_t                    _controllen;
+    COBSClassifyFunction      _classify;
+    void                     *_context;
+    const uint8_t            *_frame;
+    size_t                    _control_lengths[MaxControlFrames];  // decoded control frames
+    size_t                    _control_used;                       // bytes used in control
+    size_t                    _control_count;
+    bool                      _control_ready;                      // frame returned by readControl() is still in control
+};
+
+#endif
@@ -0,0 +1,295 @@
+/**
+ * @file    cobs_queue.h
+ * @brief   Queue of received COBS frames which are still encoded.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_queue_h
+#define ConsistentOverheadByteStuffing_queue_h
+
+/*
+ * Building block for readers which keep received frames encoded until
+ * the application asks for them (COBSFrameRelay, COBSSheddingReader,
+ * COBSPriorityReader). Bytes are read into one buffer, only the 
+ * delimiters are searched. Frames are queued by the position of their 
+ * delimiter. The stream type is a template parameter, see cobs_stream.h.
+ * It needs these methods:
+ *   int    available();
+ *   size_t readBytes(uint8_t *buffer, size_t length);
+ */
+#include <string.h>  // needed for memmove()
+#include "cobs.h"
+
+/**
+ * @brief  Receive buffer with a queue of complete, encoded frames.
+ * @tparam MaxFrames
+ *         maximum number of frames in the queue
+ */
+template <size_t MaxFrames>
+class COBSFrameQueue {
+    static_assert(MaxFrames > 0, "MaxFrames must not be 0");
+  public:
+    /**
+     * @param  buffer
+     *         buffer for received frames
+     * @param  bufferlen
+     *         Size of buffer. This is the maximum length of an encoded 
+     *         frame including its delimiter. Longer frames are dropped.
+     */
+    COBSFrameQueue(uint8_t *buffer, size_t bufferlen)
+        : _buffer(buffer), _bufferlen(bufferlen), _start(0), _scanned(0),
+          _in_len(0), _found_begin(0), _found(0), _head(0), _count(0), _dropped(0),
+          _skipping(false) {}
+
+    /**
+     * @brief  Make room in the buffer and read the bytes which are 
+     *         available from the stream (but do not wait for more). If
+     *         a frame does not fit into the empty buffer, it is dropped.
+     * @param  stream
+     *         stream to read encoded frames from
+     * @return Number of bytes read. 0 if nothing is available or the 
+     *         buffer is full of queued frames (see blocked()).
+     */
+    template <class StreamType>
+    size_t receive(StreamType &stream) {
+        compact();
+        if (_in_len == _bufferlen) {
+            if (_count > 0) return 0;
+            // frame does not fit into buffer
+            if (!_skipping) _dropped++;
+            _skipping = true;
+            _in_len = _scanned = 0;
+        }
+        int available = stream.available();
+        if (available <= 0) return 0;
+        size_t room = _bufferlen - _in_len;
+        if (static_cast<size_t>(available) < room) room = static_cast<size_t>(available);
+        const size_t n = stream.readBytes(_buffer + _in_len, room);
+        _in_len += n;
+        return n;
+    }
+
+    /**
+     * @brief  Find the next complete frame behind the queued ones. Empty
+     *         frames and the rest of a dropped frame are removed. The 
+     *         frame must then be queued with push() or taken out with 
+     *         discard(). Otherwise, the next call returns it again.
+     * @param  frame
+     *         A pointer to the encoded frame is stored here.
+     * @param  len
+     *         The length of the frame including its delimiter is stored here.
+     * @return false if no complete frame was received
+     */
+    bool next(uint8_t **frame, size_t *len) {
+        while (_scanned < _in_len) {
+            const size_t pos = _scanned + findCOBSDelimiter(_buffer + _scanned, _in_len - _scanned);
+            if (pos == _in_len) {
+                _scanned = _in_len;
+                break;
+            }
+            const size_t first = (_count > 0) ? _ends[(_head + _count - 1) % MaxFrames] + 1 : _start;
+            if (_skipping || pos == first) {
+                // rest of a dropped frame or empty frame
+                remove(first, pos + 1 - first);
+                _skipping = false;
+                continue;
+            }
+            _found_begin = first;
+            _found = pos;
+            *frame = _buffer + first;
+            *len = pos + 1 - first;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief  Queue the frame found by next(). The queue must not be full.
+     * @return Slot of the frame (0...MaxFrames-1), e.g. an index into an
+     *         array with more data about each frame
+     */
+    size_t push() {
+        const size_t slot = (_head + _count) % MaxFrames;
+        _ends[slot] = _found;
+        _scanned = _found + 1;
+        _count++;
+        return slot;
+    }
+
+    /**
+     * @brief  Take the frame found by next() out of the buffer without 
+     *         queueing it, e.g. after it was decoded elsewhere.
+     */
+    void discard() {
+        remove(_found_begin, _found + 1 - _found_begin);
+    }
+
+    /**
+     * @brief  Get the oldest queued frame. The queue must not be empty.
+     * @param  len
+     *         The length of the frame including its delimiter is stored here.
+     * @return pointer to the encoded frame, valid until the next call to
+     *         receive()
+     */
+    uint8_t *front(size_t *len) const {
+        *len = _ends[_head] + 1 - _start;
+        return _buffer + _start;
+    }
+
+    /**
+     * @brief  Get a queued frame.
+     * @param  index
+     *         0 for the oldest frame, up to count()-1
+     * @param  len
+     *         The length of the frame including its delimiter is stored here.
+     * @return pointer to the encoded frame, valid until the next call to
+     *         receive() or erase()
+     */
+    uint8_t *at(size_t index, size_t *len) const {
+        const size_t begin = (index == 0) ? _start : _ends[slot(index - 1)] + 1;
+        *len = _ends[slot(index)] + 1 - begin;
+        return _buffer + begin;
+    }
+
+    /**
+     * @brief  Get the slot of a queued frame, see push().
+     * @param  index
+     *         0 for the oldest frame, up to count()-1
+     * @return slot of the frame
+     */
+    size_t slot(size_t index) const {
+        return (_head + index) % MaxFrames;
+    }
+
+    /**
+     * @brief  Remove a queued frame. The bytes behind it are moved, and 
+     *         each frame behind it moves to the slot of the frame in 
+     *         front of it. Data kept per slot must be moved the same way.
+     * @param  index
+     *         0 for the oldest frame (same as pop()), up to count()-1
+     */
+    void erase(size_t index) {
+        if (index == 0) {
+            pop();
+            return;
+        }
+        size_t len;
+        const uint8_t *frame = at(index, &len);
+        const size_t begin = frame - _buffer;
+        memmove(_buffer + begin, _buffer + begin + len, _in_len - begin - len);
+        for (size_t i=index; i+1<_count; i++) {
+            _ends[slot(i)] = _ends[slot(i + 1)] - len;
+        }
+        _in_len -= len;
+        _scanned -= len;
+        _count--;
+    }
+
+    /**
+     * @brief  Remove the oldest frame from the queue. Its bytes stay in 
+     *         the buffer until the next call to receive().
+     */
+    void pop() {
+        _start = _ends[_head] + 1;
+        _head = (_head + 1) % MaxFrames;
+        _count--;
+    }
+
+    /**
+     * @brief  Get the number of queued frames.
+     * @return number of frames
+     */
+    size_t count() const {
+        return _count;
+    }
+
+    /**
+     * @brief  Check if no more frames can be queued.
+     * @return true if MaxFrames frames are queued
+     */
+    bool full() const {
+        return _count == MaxFrames;
+    }
+
+    /**
+     * @brief  Check if the queued frames fill the whole buffer, so 
+     *         receive() cannot read more bytes until a frame is popped.
+     * @return true if no byte can be received
+     */
+    bool blocked() const {
+        return _count > 0 && _in_len - _start == _bufferlen;
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they were too long.
+     * @return number of dropped frames
+     */
+    size_t dropped() const {
+        return _dropped;
+    }
+
+  private:
+    // remove len bytes at begin from the received bytes, they are scanned
+    void remove(size_t begin, size_t len) {
+        if (_count == 0 && begin == _start) {
+            // nothing queued in front, skip the bytes instead of moving the rest
+            _start += len;
+            _scanned = _start;
+            return;
+        }
+        memmove(_buffer + begin, _buffer + begin + len, _in_len - begin - len);
+        _in_len -= len;
+        _scanned = begin;
+    }
+
+    // move the bytes of queued frames to the start of the buffer
+    void compact() {
+        if (_start == 0) return;
+        memmove(_buffer, _buffer + _start, _in_len - _start);
+        for (size_t i=0; i<_count; i++) {
+            _ends[(_head + i) % MaxFrames] -= _start;
+        }
+        _in_len -= _start;
+        _scanned -= _start;
+        _start = 0;
+    }
+
+    uint8_t *_buffer;
+    size_t   _bufferlen;
+    size_t   _start;     // start of oldest queued frame
+    size_t   _scanned;   // end of bytes searched for a delimiter
+    size_t   _in_len;    // end of received bytes
+    size_t   _found_begin;  // frame found by next()
+    size_t   _found;        // delimiter of frame found by next()
+    size_t   _ends[MaxFrames];  // position of delimiter of each queued frame
+    size_t   _head;
+    size_t   _count;
+    size_t   _dropped;
+    bool     _skipping;  // dropping rest of a too long frame
+};
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file    cobs_relay.h
+ * @brief   Forward COBS frames between streams without decoding them.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_relay_h
+#define ConsistentOverheadByteStuffing_relay_h
+
+/*
+ * A relay only looks for the delimiters between frames. Frames are 
+ * passed on in their encoded form, only the header bytes needed for
+ * routing are decoded (with decodeCOBS_prefix()). The stream type is a
+ * template parameter, see cobs_stream.h. It needs these methods:
+ *   int    available();
+ *   size_t readBytes(uint8_t *buffer, size_t length);
+ */
+#include "cobs.h"
+#include "cobs_queue.h"
+
+/**
+ * @brief  Read COBS encoded frames from a stream without decoding them.
+ */
+template <class StreamType>
+class COBSFrameRelay {
+  public:
+    /**
+     * @param  stream
+     *         stream to read encoded frames from
+     * @param  buffer
+     *         buffer for receiving frames
+     * @param  bufferlen
+     *         Size of buffer. This is the maximum length of an encoded 
+     *         frame including its delimiter. Longer frames are dropped.
+     */
+    COBSFrameRelay(StreamType &stream, uint8_t *buffer, size_t bufferlen)
+        : _stream(stream), _queue(buffer, bufferlen), _frame(buffer), _frame_len(0) {}
+
+    /**
+     * @brief  Read all available bytes from the stream (but do not wait
+     *         for more) and look for the end of the next frame.
+     * @return Length of the encoded frame including its delimiter if a 
+     *         frame is complete, 0 otherwise. The frame can be accessed 
+     *         with frame() and is valid until the next call to read(). 
+     *         Empty frames are skipped.
+     */
+    size_t read() {
+        if (_frame_len > 0) {
+            _queue.pop();
+            _frame_len = 0;
+        }
+        while (true) {
+            uint8_t *frame;
+            size_t len;
+            if (_queue.next(&frame, &len)) {
+                _queue.push();
+                _frame = frame;
+                _frame_len = len;
+                return _frame_len;
+            }
+            if (_queue.receive(_stream) == 0) return 0;
+        }
+    }
+
+    /**
+     * @brief  Get the last frame returned by read().
+     * @return pointer to the encoded bytes, ending with the delimiter
+     */
+    const uint8_t *frame() const {
+        return _frame;
+    }
+
+    /**
+     * @brief  Decode the first bytes of the last frame returned by read().
+     * @param  outptr
+     *         pointer to buffer for the decoded header bytes
+     * @param  outputlen
+     *         number of header bytes wanted
+     * @return Number of bytes written to outptr. This is less than 
+     *         outputlen if the frame is shorter.
+     */
+    size_t header(uint8_t *outptr, size_t outputlen) const {
+        return decodeCOBS_prefix(frame(), _frame_len, outptr, outputlen);
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they were too long.
+     * @return number of dropped frames
+     */
+    size_t dropped() const {
+        return _queue.dropped();
+    }
+
+  private:
+    StreamType        &_stream;
+    COBSFrameQueue<1>  _queue;
+    const uint8_t     *_frame;      // frame returned by last read()
+    size_t             _frame_len;
+};
+
+#endif
@@ -0,0 +1,201 @@
+/**
+ * @file    cobs_shedding.h
+ * @brief   Receive COBS frames with deadlines and drop expired ones undecoded.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_shedding_h
+#define ConsistentOverheadByteStuffing_shedding_h
+
+/*
+ * Each frame gets a time stamp when its delimiter is received. The first
+ * decoded byte of a frame is taken as its type, and a function provided
+ * by the application tells the maximum age of each type. Frames which
+ * are too old when the application asks for them are dropped without
+ * being decoded. The stream type is a template parameter, see 
+ * cobs_stream.h. It needs these methods:
+ *   int    available();
+ *   size_t readBytes(uint8_t *buffer, size_t length);
+ */
+#include "cobs.h"
+#include "cobs_queue.h"
+
+/*
+ * Return the maximum age in microseconds for frames of the given type,
+ * 0 for frames which never expire.
+ */
+typedef uint32_t (*COBSDeadlineFunction)(uint8_t type, void *context);
+
+/**
+ * @brief  Receive queue for COBS encoded frames which drops frames
+ *         when they are older than the deadline for their type.
+ * @tparam StreamType
+ *         type of the stream
+ * @tparam MaxFrames
+ *         maximum number of received frames waiting to be read
+ */
+template <class StreamType, size_t MaxFrames>
+class COBSSheddingReader {
+  public:
+    /**
+     * @param  stream
+     *         stream to read encoded frames from
+     * @param  buffer
+     *         buffer for received frames
+     * @param  bufferlen
+     *         Size of buffer. This is the maximum length of an encoded 
+     *         frame including its delimiter. Longer frames are dropped.
+     * @param  deadline
+     *         function which returns the maximum age of a frame type
+     * @param  context
+     *         passed to deadline
+     */
+    COBSSheddingReader(StreamType &stream, uint8_t *buffer, size_t bufferlen,
+                       COBSDeadlineFunction deadline, void *context=0)
+        : _stream(stream), _queue(buffer, bufferlen),
+          _deadline(deadline), _context(context), _frame(buffer), _shed(0) {}
+
+    /**
+     * @brief  Read all available bytes from the stream (but do not wait
+     *         for more) and time stamp the frames completed by them. When
+     *         the buffer is full, expired frames anywhere in the queue are
+     *         dropped to make room.
+     *         Bytes which still do not fit are left in the stream.
+     * @param  now_us
+     *         current time in microseconds (like micros() on Arduino),
+     *         may wrap around
+     * @return number of frames waiting to be read
+     */
+    size_t receive(uint32_t now_us) {
+        while (true) {
+            scan(now_us);
+            if (_queue.full() || _queue.blocked()) {
+                if (!shedExpired(now_us)) break;
+                continue;
+            }
+            if (_queue.receive(_stream) == 0) break;
+        }
+        return _queue.count();
+    }
+
+    /**
+     * @brief  Decode the oldest frame which has not expired yet. All
+     *         expired frames in the queue are dropped without decoding
+     *         them, also those behind frames which have not expired.
+     * @param  now_us
+     *         current time in microseconds
+     * @return Length of the decoded frame, 0 if no frame is waiting. The
+     *         decoded frame can be accessed with frame() and is valid
+     *         until the next call to read() or receive().
+     */
+    size_t read(uint32_t now_us) {
+        while (true) {
+            // frames which did not fit into the queue get their time stamp now
+            scan(now_us);
+            if (_queue.count() == 0) return 0;
+            if (shedExpired(now_us)) continue;
+            size_t len;
+            uint8_t *frame = _queue.front(&len);
+            _queue.pop();
+            const size_t decoded = decodeCOBS_inplace(frame, len);
+            if (decoded > 0) {
+                _frame = frame;
+                return decoded;
+            }
+        }
+    }
+
+    /**
+     * @brief  Get the last frame returned by read().
+     * @return pointer to the decoded bytes
+     */
+    const uint8_t *frame() const {
+        return _frame;
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they expired.
+     * @return number of expired frames
+     */
+    size_t shed() const {
+        return _shed;
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they were too long.
+     * @return number of dropped frames
+     */
+    size_t dropped() const {
+        return _queue.dropped();
+    }
+
+  private:
+    // find delimiters in the received bytes and time stamp the frames
+    void scan(uint32_t now_us) {
+        uint8_t *frame;
+        size_t len;
+        while (!_queue.full() && _queue.next(&frame, &len)) {
+            _stamps[_queue.push()] = now_us;
+        }
+    }
+
+    // drop expired frames anywhere in the queue, so a frame which never
+    // expires does not keep the ones behind it
+    bool shedExpired(uint32_t now_us) {
+        bool any = false;
+        size_t i = 0;
+        while (i < _queue.count()) {
+            uint8_t type;
+            size_t len;
+            const uint8_t *frame = _queue.at(i, &len);
+            if (decodeCOBS_prefix(frame, len, &type, 1) == 0) type = 0x00;
+            const uint32_t max_age = _deadline ? _deadline(type, _context) : 0;
+            if (max_age == 0 || static_cast<uint32_t>(now_us - _stamps[_queue.slot(i)]) <= max_age) {
+                i++;
+                continue;
+            }
+            // the frames behind move one slot forward
+            for (size_t j=i; j+1<_queue.count(); j++) {
+                _stamps[_queue.slot(j)] = _stamps[_queue.slot(j + 1)];
+            }
+            _queue.erase(i);
+            _shed++;
+            any = true;
+        }
+        return any;
+    }
+
+    StreamType               &_stream;
+    COBSFrameQueue<MaxFrames> _queue;
+    COBSDeadlineFunction      _deadline;
+    void                     *_context;
+    const uint8_t            *_frame;
+    uint32_t                  _stamps[MaxFrames];  // time when delimiter was received
+    size_t                    _shed;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * @file    cobs_static.h
+ * @brief   Statically allocated buffers for the COBS streaming classes.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_static_h
+#define ConsistentOverheadByteStuffing_static_h
+
+/*
+ * The streaming classes take buffers from the caller. The templates in
+ * this file own their buffers instead, with all sizes fixed at compile
+ * time. Nothing is allocated on the heap, and sizeof() of an object is
+ * all the RAM it uses. Wrong sizes are caught by static_assert().
+ */
+#include "cobs.h"
+#include "cobs_stream.h"
+#include "cobs_broadcast.h"
+
+// Storage for the buffer of a reader. Base class, so the buffer exists
+// before the reader which uses it is constructed.
+template <size_t N>
+struct COBSStaticBuffer {
+    uint8_t data[N];
+};
+
+/**
+ * @brief  COBSStreamReader with its own buffer.
+ * @tparam StreamType
+ *         type of the stream
+ * @tparam MaxFrameSize
+ *         maximum length of a decoded frame
+ */
+template <class StreamType, size_t MaxFrameSize>
+class COBSStaticStreamReader : private COBSStaticBuffer<MaxFrameSize>, public COBSStreamReader<StreamType> {
+    static_assert(MaxFrameSize > 0, "MaxFrameSize must not be 0");
+  public:
+    explicit COBSStaticStreamReader(StreamType &stream)
+        : COBSStreamReader<StreamType>(stream, COBSStaticBuffer<MaxFrameSize>::data, MaxFrameSize) {}
+};
+
+/**
+ * @brief  Fixed number of slots for encoded frames, to be put on 
+ *         transmit queues. A slot is free again when all queues have
+ *         written its frame.
+ * @tparam MaxFrameSize
+ *         maximum length of a frame before encoding
+ * @tparam Slots
+ *         number of frames
+ */
+template <size_t MaxFrameSize, size_t Slots>
+class COBSFramePool {
+    static_assert(MaxFrameSize > 0, "MaxFrameSize must not be 0");
+    static_assert(Slots > 0, "Slots must not be 0");
+    static_assert(getCOBSBufferSize(MaxFrameSize) > MaxFrameSize, "MaxFrameSize too large");
+  public:
+    static const size_t SLOT_SIZE = getCOBSBufferSize(MaxFrameSize);
+
+    /**
+     * @brief  Encode a frame into a free slot. Afterwards, the caller 
+     *         holds one reference to the frame and must call release() 
+     *         when it has put the frame on all queues.
+     * @param  inptr
+     *         pointer to buffer with bytes to encode
+     * @param  inputlen
+     *         number of bytes to encode, at most MaxFrameSize
+     * @return the encoded frame, NULL if the frame is too long or no
+     *         slot is free
+     */
+    COBSSharedFrame *encode(const uint8_t *inptr, size_t inputlen) {
+        if (inputlen > MaxFrameSize) return 0;
+        for (size_t i=0; i<Slots; i++) {
+            if (_frames[i].references() == 0) {
+                _frames[i].encode(inptr, inputlen, _buffers[i], SLOT_SIZE);
+                return &_frames[i];
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief  Get the number of free slots.
+     * @return number of free slots
+     */
+    size_t available() const {
+        size_t count = 0;
+        for (size_t i=0; i<Slots; i++) {
+            if (_frames[i].references() == 0) count++;
+        }
+        return count;
+    }
+
+  private:
+    COBSSharedFrame _frames[Slots];
+    uint8_t         _buffers[Slots][SLOT_SIZE];
+};
+
+template <size_t MaxFrameSize, size_t Slots>
+const size_t COBSFramePool<MaxFrameSize, Slots>::SLOT_SIZE;
+
+/**
+ * @brief  Receive and transmit buffers for one stream: a reader for 
+ *         frames of up to MaxFrameSize bytes, TxSlots frames to send and
+ *         a transmit queue of TxQueueLength frames.
+ */
+template <class StreamType, size_t MaxFrameSize, size_t TxSlots, size_t TxQueueLength>
+class COBSStaticLink {
+    static_assert(TxQueueLength >= TxSlots, "TxQueueLength must be at least TxSlots");
+  public:
+    explicit COBSStaticLink(StreamType &stream) : reader(stream), queue(stream) {}
+
+    /**
+     * @brief  Encode a frame and put it on the transmit queue.
+     * @return false if the frame is too long or no slot is free
+     */
+    bool send(const uint8_t *inptr, size_t inputlen) {
+        COBSSharedFrame *frame = pool.encode(inptr, inputlen);
+        if (frame == 0) return false;
+        const bool queued = queue.push(frame);
+        frame->release();
+        return queued;
+    }
+
+    /**
+     * @brief  Get the RAM used by this object.
+     * @return size in bytes
+     */
+    static constexpr size_t ramUsage() {
+        return sizeof(COBSStaticLink);
+    }
+
+    COBSStaticStreamReader<StreamType, MaxFrameSize>   reader;
+    COBSFramePool<MaxFrameSize, TxSlots>               pool;
+    COBSTransmitQueue<StreamType, TxQueueLength>       queue;
+};
+
+#endif
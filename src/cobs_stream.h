@@ -0,0 +1,330 @@
+/**
+ * @file    cobs_stream.h
+ * @brief   Read and write COBS frames on Arduino-style byte streams.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_stream_h
+#define ConsistentOverheadByteStuffing_stream_h
+
+/*
+ * The stream type is a template parameter. This keeps the library
+ * independent of Arduino.h. Any class works which provides these
+ * methods (like Arduino's Stream class does):
+ *   int    available();
+ *   size_t readBytes(uint8_t *buffer, size_t length);
+ *   size_t write(const uint8_t *buffer, size_t size);
+ */
+#include <string.h>  // needed for memmove() and memcpy()
+#include "cobs.h"
+
+/**
+ * @brief  Encode a buffer of bytes using the COBS algorithm and write
+ *         the result directly to a stream.
+ * @param  stream
+ *         stream to write the encoded bytes to
+ * @param  inptr
+ *         pointer to buffer with bytes to encode
+ * @param  inputlen
+ *         number of bytes to take from input buffer to encode
+ * @param  add_trailing_zero
+ *         when this is true, a zero byte will be appended
+ *         to the output written to the stream.
+ * @return Number of bytes written to the stream.
+ * @note   No output buffer is needed. Each block is written with two
+ *         bulk calls, one for the code byte and one for the data bytes
+ *         taken directly from inptr.
+ */
+template <class StreamType>
+size_t writeCOBS(StreamType &stream, const uint8_t *inptr, size_t inputlen, bool add_trailing_zero=true) {
+    COBSEncodeSegments segments(inptr, inputlen);
+    uint8_t code;
+    const uint8_t *data;
+    size_t datalen;
+    size_t total = 0;
+    while (segments.next(&code, &data, &datalen)) {
+        total += stream.write(&code, 1);
+        total += stream.write(data, datalen);
+    }
+    if (add_trailing_zero) {
+        const uint8_t zero = 0x00;
+        total += stream.write(&zero, 1);
+    }
+    return total;
+}
+
+/**
+ * @brief  Read all available bytes from a stream (but do not wait for 
+ *         more) into a buffer and decode them in-place. This is the 
+ *         logic of COBSStreamReader::read(). The state is kept by the 
+ *         caller, so readers with other storage (e.g. COBSEndpointPool)
+ *         can share it. All state must be zero/false initially.
+ * @param  stream
+ *         stream to read encoded bytes from
+ * @param  buffer
+ *         buffer for receiving and decoding frames
+ * @param  bufferlen
+ *         size of buffer, the maximum length of a decoded frame
+ * @param  decoder
+ *         state of the decoder
+ * @param  in_pos
+ *         next encoded byte to decode
+ * @param  in_len
+ *         end of encoded bytes
+ * @param  out_len
+ *         end of decoded bytes
+ * @param  dropped
+ *         incremented for each frame dropped because it is too long
+ * @param  frame_ready
+ *         true while a frame returned by the last call is in the buffer
+ * @param  skipping
+ *         true while the rest of a too long frame is dropped
+ * @return Length of the decoded frame if a frame is complete, 0 otherwise.
+ *         The decoded frame starts at buffer and is valid until the next
+ *         call. Empty frames are skipped.
+ */
+template <class StreamType, class PosType, class CountType>
+size_t readCOBSBuffered(StreamType &stream, uint8_t *buffer, size_t bufferlen, COBSDecoder &decoder,
+                        PosType &in_pos, PosType &in_len, PosType &out_len, CountType &dropped,
+                        bool &frame_ready, bool &skipping) {
+    if (frame_ready) {
+        // move bytes of next frame(s) to start of buffer
+        memmove(buffer, buffer + in_pos, in_len - in_pos);
+        in_len = static_cast<PosType>(in_len - in_pos);
+        in_pos = 0;
+        out_len = 0;
+        frame_ready = false;
+    }
+    while (true) {
+        if (in_pos == in_len) {
+            // Everything is decoded. Decoded bytes never take more
+            // space than encoded bytes, so the space after the
+            // decoded bytes can be re-used.
+            in_pos = in_len = out_len;
+            int available = stream.available();
+            if (available <= 0) return 0;
+            if (out_len == bufferlen) {
+                // Buffer is full. Only bytes which do not add to the 
+                // decoded frame (like the delimiter) can be accepted.
+                uint8_t next;
+                size_t written;
+                if (stream.readBytes(&next, 1) == 0) return 0;
+                if (decoder.decode(&next, 1, buffer + bufferlen, 0, &written) == 1) {
+                    if (decoder.frameComplete()) {
+                        frame_ready = true;
+                        return out_len;
+                    }
+                    continue;
+                }
+                // frame does not fit into buffer
+                dropped++;
+                skipping = true;
+                buffer[0] = next;
+                in_pos = 0;
+                in_len = 1;
+                out_len = 0;
+                continue;
+            }
+            size_t room = bufferlen - in_len;
+            if (static_cast<size_t>(available) < room) room = static_cast<size_t>(available);
+            in_len = static_cast<PosType>(in_len + stream.readBytes(buffer + in_len, room));
+            if (in_pos == in_len) return 0;
+        }
+        size_t written;
+        in_pos = static_cast<PosType>(in_pos + decoder.decode(buffer + in_pos, in_len - in_pos,
+                                                             buffer + out_len, bufferlen - out_len, &written));
+        out_len = static_cast<PosType>(out_len + written);
+        if (skipping) {
+            out_len = 0;
+        }
+        if (decoder.frameComplete()) {
+            if (out_len > 0) {
+                frame_ready = true;
+                return out_len;
+            }
+            skipping = false;
+        }
+    }
+}
+
+/**
+ * @brief  Read COBS encoded frames from a stream. Bytes are read in bulk
+ *         and decoded in-place within one buffer provided by the caller.
+ */
+template <class StreamType>
+class COBSStreamReader {
+  public:
+    /**
+     * @param  stream
+     *         stream to read encoded bytes from
+     * @param  buffer
+     *         buffer for receiving and decoding frames
+     * @param  bufferlen
+     *         Size of buffer. This is the maximum length of a decoded
+     *         frame. Longer frames are dropped.
+     */
+    COBSStreamReader(StreamType &stream, uint8_t *buffer, size_t bufferlen)
+        : _stream(stream), _buffer(buffer), _bufferlen(bufferlen),
+          _in_pos(0), _in_len(0), _out_len(0), _dropped(0),
+          _frame_ready(false), _skipping(false) {}
+
+    /**
+     * @brief  Read all available bytes from the stream (but do not wait
+     *         for more) and decode them.
+     * @return Length of the decoded frame if a frame is complete, 0 otherwise.
+     *         The decoded frame can be accessed with frame() and is valid
+     *         until the next call to read(). Empty frames are skipped.
+     */
+    size_t read() {
+        return readCOBSBuffered(_stream, _buffer, _bufferlen, _decoder, _in_pos, _in_len, _out_len,
+                                _dropped, _frame_ready, _skipping);
+    }
+
+    /**
+     * @brief  Get the last frame returned by read().
+     * @return pointer to the decoded bytes
+     */
+    const uint8_t *frame() const {
+        return _buffer;
+    }
+
+    /**
+     * @brief  Get the number of frames dropped because they were too long.
+     * @return number of dropped frames
+     */
+    size_t dropped() const {
+        return _dropped;
+    }
+
+    /**
+     * @brief  Get the number of bytes needed by saveState().
+     * @return size of the saved state
+     */
+    size_t stateSize() const {
+        return STATE_HEADER_SIZE + decodedLength() + (_in_len - _in_pos);
+    }
+
+    /**
+     * @brief  Save the state of the reader: the decoder state, the bytes 
+     *         of an unfinished frame and bytes already read from the
+     *         stream but not decoded yet. A new reader (e.g. in a new 
+     *         process which takes over the connection) can continue
+     *         with restoreState() without losing or corrupting a frame.
+     * @param  outptr
+     *         pointer to buffer to write the state to
+     * @param  outlen
+     *         size of buffer, must be at least stateSize()
+     * @return Number of bytes written. 0 if the buffer is too small.
+     * @note   A frame returned by the last call to read() is not saved.
+     */
+    size_t saveState(uint8_t *outptr, size_t outlen) const {
+        const size_t decoded = decodedLength();
+        const size_t undecoded = _in_len - _in_pos;
+        if (outlen < stateSize()) return 0;
+        outptr[0] = STATE_VERSION;
+        outptr[1] = _skipping ? 0x01 : 0x00;
+        putSize(outptr + 2, _dropped);
+        putSize(outptr + 6, decoded);
+        putSize(outptr + 10, undecoded);
+        if (_decoder.saveState(outptr + 14, COBSDecoder::STATE_SIZE) == 0) return 0;
+        memcpy(outptr + STATE_HEADER_SIZE, _buffer, decoded);
+        memcpy(outptr + STATE_HEADER_SIZE + decoded, _buffer + _in_pos, undecoded);
+        return STATE_HEADER_SIZE + decoded + undecoded;
+    }
+
+    /**
+     * @brief  Restore a state written by saveState().
+     * @param  inptr
+     *         pointer to buffer with saved state
+     * @param  inputlen
+     *         number of bytes in buffer
+     * @return true if the state was restored. On false, the state is 
+     *         invalid or does not fit into the buffer of this reader. 
+     *         The reader then starts with the next frame.
+     */
+    bool restoreState(const uint8_t *inptr, size_t inputlen) {
+        _in_pos = _in_len = _out_len = 0;
+        _frame_ready = false;
+        _skipping = false;
+        _decoder.reset();
+        if (inputlen < STATE_HEADER_SIZE || inptr[0] != STATE_VERSION || (inptr[1] & ~0x01) != 0) {
+            return false;
+        }
+        const size_t decoded = getSize(inptr + 6);
+        const size_t undecoded = getSize(inptr + 10);
+        if (decoded > _bufferlen || undecoded > _bufferlen - decoded 
+            || inputlen - STATE_HEADER_SIZE != decoded + undecoded
+            || !_decoder.restoreState(inptr + 14, COBSDecoder::STATE_SIZE)) {
+            _decoder.reset();
+            return false;
+        }
+        _skipping = (inptr[1] & 0x01) != 0;
+        _dropped = getSize(inptr + 2);
+        memcpy(_buffer, inptr + STATE_HEADER_SIZE, decoded + undecoded);
+        _out_len = _in_pos = decoded;
+        _in_len = decoded + undecoded;
+        return true;
+    }
+
+  private:
+    static const uint8_t STATE_VERSION = 1;
+    static const size_t  STATE_HEADER_SIZE = 14 + COBSDecoder::STATE_SIZE;
+
+    // decoded bytes of the unfinished frame
+    size_t decodedLength() const {
+        return _frame_ready ? 0 : _out_len;
+    }
+
+    // lengths are stored as 32 bit little endian values
+    static void putSize(uint8_t *outptr, size_t value) {
+        for (uint8_t i=0; i<4; i++) {
+            outptr[i] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i));
+        }
+    }
+
+    static size_t getSize(const uint8_t *inptr) {
+        uint32_t value = 0;
+        for (uint8_t i=0; i<4; i++) {
+            value |= static_cast<uint32_t>(inptr[i]) << (8 * i);
+        }
+        // larger than any buffer if size_t has less than 32 bits
+        return (static_cast<size_t>(value) == value) ? static_cast<size_t>(value) : static_cast<size_t>(-1);
+    }
+
+    StreamType  &_stream;
+    uint8_t     *_buffer;
+    size_t       _bufferlen;
+    size_t       _in_pos;      // next encoded byte to decode
+    size_t       _in_len;      // end of encoded bytes
+    size_t       _out_len;     // end of decoded bytes
+    size_t       _dropped;
+    COBSDecoder  _decoder;
+    bool         _frame_ready; // frame was returned by last call to read()
+    bool         _skipping;    // dropping rest of a too long frame
+};
+
+#endif
@@ -0,0 +1,247 @@
+/**
+ * @file    cobs_streambuf.h
+ * @brief   std::streambuf adaptors for the COBS library.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_streambuf_h
+#define ConsistentOverheadByteStuffing_streambuf_h
+
+/*
+ * This header needs a hosted C++ standard library. It is not included
+ * by cobs.h and therefore not used on platforms without <streambuf>.
+ */
+#include <streambuf>
+#include <ostream>
+#include <vector>
+#include <string.h>
+#include "cobs.h"
+
+/**
+ * @brief  Output stream buffer which COBS encodes everything written to it
+ *         and passes the encoded bytes on to another stream buffer.
+ *         Use cobs_endframe to finish a frame.
+ */
+class cobs_ostreambuf : public std::streambuf {
+  public:
+    /**
+     * @param  sink
+     *         stream buffer which receives the encoded bytes
+     * @param  buffer_size
+     *         size of the internal buffers. Larger writes are
+     *         encoded directly from the caller's buffer.
+     */
+    explicit cobs_ostreambuf(std::streambuf *sink, size_t buffer_size=65536)
+        : _sink(sink),
+          _in(buffer_size > 0 ? buffer_size : 1),
+          _out(getCOBSBufferSize(_in.size()) > 256 ? getCOBSBufferSize(_in.size()) : 256),
+          _out_len(0) {
+        setp(&_in[0], &_in[0] + _in.size());
+    }
+
+    ~cobs_ostreambuf() {
+        sync();
+    }
+
+    /**
+     * @brief  Finish the current frame and start a new one.
+     * @return false if the sink did not accept the encoded bytes
+     */
+    bool end_frame(bool add_trailing_zero=true) {
+        if (!drain()) return false;
+        if (_out.size() - _out_len < _encoder.pending() + 1 && !flush_out()) return false;
+        _out_len += _encoder.finish(&_out[_out_len], _out.size() - _out_len, add_trailing_zero);
+        return true;
+    }
+
+  protected:
+    int_type overflow(int_type ch) {
+        if (!drain()) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) {
+        if (n < epptr() - pptr()) {
+            memcpy(pptr(), s, static_cast<size_t>(n));
+            pbump(static_cast<int>(n));
+            return n;
+        }
+        // large write: bypass the put area
+        if (!drain() || !encode(s, static_cast<size_t>(n))) return 0;
+        return n;
+    }
+
+    // Note: Only complete COBS blocks can be passed on to the sink.
+    // Up to 254 bytes of an unfinished frame stay in the encoder.
+    int sync() {
+        if (!drain() || !flush_out()) return -1;
+        return _sink->pubsync();
+    }
+
+  private:
+    // encode content of put area
+    bool drain() {
+        const size_t len = static_cast<size_t>(pptr() - pbase());
+        setp(&_in[0], &_in[0] + _in.size());
+        return encode(&_in[0], len);
+    }
+
+    bool encode(const char *s, size_t n) {
+        const uint8_t *inptr = reinterpret_cast<const uint8_t *>(s);
+        while (n > 0) {
+            size_t written;
+            size_t consumed = _encoder.encode(inptr, n, &_out[_out_len], _out.size() - _out_len, &written);
+            _out_len += written;
+            inptr += consumed;
+            n -= consumed;
+            if (n > 0 && !flush_out()) return false;
+        }
+        return true;
+    }
+
+    bool flush_out() {
+        const std::streamsize len = static_cast<std::streamsize>(_out_len);
+        if (len > 0 && _sink->sputn(reinterpret_cast<const char *>(&_out[0]), len) != len) return false;
+        _out_len = 0;
+        return true;
+    }
+
+    std::streambuf      *_sink;
+    COBSEncoder          _encoder;
+    std::vector<char>    _in;      // put area
+    std::vector<uint8_t> _out;     // encoded bytes not yet passed to sink
+    size_t               _out_len;
+};
+
+/**
+ * @brief  Manipulator to finish a frame on a std::ostream which uses a
+ *         cobs_ostreambuf. Sets badbit on any other stream.
+ */
+inline std::ostream &cobs_endframe(std::ostream &os) {
+    cobs_ostreambuf *buf = dynamic_cast<cobs_ostreambuf *>(os.rdbuf());
+    if (buf == 0 || !buf->end_frame()) {
+        os.setstate(std::ios_base::badbit);
+    }
+    return os;
+}
+
+/**
+ * @brief  Input stream buffer which reads COBS encoded frames from another
+ *         stream buffer and provides the decoded bytes.
+ *         The end of each frame is signalled as end of file. Call
+ *         next_frame() to continue with the next frame.
+ */
+class cobs_istreambuf : public std::streambuf {
+  public:
+    /**
+     * @param  source
+     *         stream buffer to read encoded bytes from
+     * @param  buffer_size
+     *         size of the internal buffers
+     */
+    explicit cobs_istreambuf(std::streambuf *source, size_t buffer_size=65536)
+        : _source(source),
+          _raw(buffer_size > 0 ? buffer_size : 1),
+          _raw_pos(0),
+          _raw_len(0),
+          _get(buffer_size > 0 ? buffer_size : 1),
+          _frame_done(false),
+          _source_done(false) {
+        setg(&_get[0], &_get[0], &_get[0]);
+    }
+
+    /**
+     * @brief  Skip the rest of the current frame and start reading the next one.
+     * @return false if the source has no more data
+     */
+    bool next_frame() {
+        while (!_frame_done) {
+            fill();
+        }
+        if (_raw_pos == _raw_len && !refill()) return false;
+        _frame_done = false;
+        setg(&_get[0], &_get[0], &_get[0]);
+        return true;
+    }
+
+  protected:
+    int_type underflow() {
+        if (gptr() == egptr() && !fill()) return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    // decode the next chunk of the current frame into the get area
+    bool fill() {
+        while (!_frame_done) {
+            if (_raw_pos == _raw_len && !refill()) {
+                // end of source also ends the current frame
+                _frame_done = true;
+                break;
+            }
+            size_t written;
+            _raw_pos += _decoder.decode(&_raw[_raw_pos], _raw_len - _raw_pos,
+                                        reinterpret_cast<uint8_t *>(&_get[0]), _get.size(), &written);
+            _frame_done = _decoder.frameComplete();
+            if (written > 0) {
+                setg(&_get[0], &_get[0], &_get[0] + written);
+                return true;
+            }
+        }
+        setg(&_get[0], &_get[0], &_get[0]);
+        return false;
+    }
+
+    // read the next block of encoded bytes from the source
+    bool refill() {
+        if (_source_done) return false;
+        std::streamsize n = _source->sgetn(reinterpret_cast<char *>(&_raw[0]),
+                                           static_cast<std::streamsize>(_raw.size()));
+        if (n <= 0) {
+            _source_done = true;
+            return false;
+        }
+        _raw_pos = 0;
+        _raw_len = static_cast<size_t>(n);
+        return true;
+    }
+
+    std::streambuf      *_source;
+    COBSDecoder          _decoder;
+    std::vector<uint8_t> _raw;     // encoded bytes read from source
+    size_t               _raw_pos;
+    size_t               _raw_len;
+    std::vector<char>    _get;     // get area, decoded bytes
+    bool                 _frame_done;
+    bool                 _source_done;
+};
+
+#endif
@@ -0,0 +1,271 @@
+/**
+ * @file    cobs_views.h
+ * @brief   C++20 range adaptors for the COBS library.
+ * @author  Andreas Grommek
+ *
+ * @section license License
+ *
+ * The MIT Licence (MIT)
+ *
+ * Copyright (c) 2021 Andreas Grommek
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ConsistentOverheadByteStuffing_views_h
+#define ConsistentOverheadByteStuffing_views_h
+
+/*
+ * This header needs C++20 and a hosted C++ standard library. It is not
+ * included by cobs.h. The views are thin wrappers around
+ * COBSEncodeSegments and COBSDecodeSegments from cobs.h.
+ */
+#if __cplusplus < 202002L
+#error "cobs_views.h needs C++20"
+#endif
+
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include "cobs.h"
+
+namespace cobs {
+
+// Input ranges must be contiguous ranges of bytes.
+template <class R>
+concept byte_range = std::ranges::contiguous_range<R> && std::ranges::sized_range<R>
+                  && std::same_as<std::remove_cv_t<std::ranges::range_value_t<R>>, uint8_t>;
+
+/**
+ * @brief  Iterator over the bytes of the COBS encoded input (without
+ *         trailing zero). Bytes are produced on the fly.
+ */
+class encode_iterator {
+  public:
+    using value_type = uint8_t;
+    using difference_type = std::ptrdiff_t;
+
+    encode_iterator() = default;
+    encode_iterator(const uint8_t *inptr, size_t inputlen) : _segments(inptr, inputlen) {
+        fetch();
+    }
+
+    uint8_t operator*() const {
+        return _at_code ? _code : _data[_idx];
+    }
+
+    encode_iterator &operator++() {
+        if (_at_code) {
+            _at_code = false;
+        }
+        else {
+            _idx++;
+        }
+        if (!_at_code && _idx == _datalen) fetch();
+        return *this;
+    }
+
+    encode_iterator operator++(int) {
+        encode_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    bool operator==(const encode_iterator &other) const {
+        if (_done || other._done) return _done == other._done;
+        return _at_code == other._at_code && _data + _idx == other._data + other._idx;
+    }
+
+    bool operator==(std::default_sentinel_t) const {
+        return _done;
+    }
+
+  private:
+    void fetch() {
+        _idx = 0;
+        _at_code = _segments.next(&_code, &_data, &_datalen);
+        _done = !_at_code;
+    }
+
+    COBSEncodeSegments _segments{nullptr, 0};
+    const uint8_t     *_data = nullptr;
+    size_t             _datalen = 0;
+    size_t             _idx = 0;
+    uint8_t            _code = 0;
+    bool               _at_code = false;
+    bool               _done = true;
+};
+
+/**
+ * @brief  Iterator over the bytes of the COBS decoded input. Bytes are
+ *         produced on the fly.
+ */
+class decode_iterator {
+  public:
+    using value_type = uint8_t;
+    using difference_type = std::ptrdiff_t;
+
+    decode_iterator() = default;
+    decode_iterator(const uint8_t *inptr, size_t inputlen) : _segments(inptr, inputlen) {
+        _done = false;
+        fetch();
+    }
+
+    uint8_t operator*() const {
+        return _at_zero ? 0x00 : _data[_idx];
+    }
+
+    decode_iterator &operator++() {
+        if (_at_zero) {
+            fetch();
+        }
+        else if (++_idx == _datalen) {
+            if (_zero_follows) {
+                _at_zero = true;
+            }
+            else {
+                fetch();
+            }
+        }
+        return *this;
+    }
+
+    decode_iterator operator++(int) {
+        decode_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    bool operator==(const decode_iterator &other) const {
+        if (_done || other._done) return _done == other._done;
+        return _at_zero == other._at_zero && _data + _idx == other._data + other._idx;
+    }
+
+    bool operator==(std::default_sentinel_t) const {
+        return _done;
+    }
+
+  private:
+    // skip empty runs which are not followed by a zero byte
+    void fetch() {
+        _idx = 0;
+        _at_zero = false;
+        while (_segments.next(&_data, &_datalen, &_zero_follows)) {
+            if (_datalen > 0) return;
+            if (_zero_follows) {
+                _at_zero = true;
+                return;
+            }
+        }
+        _done = true;
+    }
+
+    COBSDecodeSegments _segments{nullptr, 0};
+    const uint8_t     *_data = nullptr;
+    size_t             _datalen = 0;
+    size_t             _idx = 0;
+    bool               _zero_follows = false;
+    bool               _at_zero = false;
+    bool               _done = true;
+};
+
+/**
+ * @brief  Lazy view of the COBS encoded bytes of a contiguous range.
+ *         segments() gives block-wise access for algorithms which
+ *         can process whole runs at once.
+ */
+template <std::ranges::view V>
+    requires byte_range<V>
+class encode_view : public std::ranges::view_interface<encode_view<V>> {
+  public:
+    encode_view() = default;
+    explicit encode_view(V base) : _base(std::move(base)) {}
+
+    encode_iterator begin() const {
+        return encode_iterator(std::ranges::data(_base), std::ranges::size(_base));
+    }
+
+    std::default_sentinel_t end() const {
+        return std::default_sentinel;
+    }
+
+    COBSEncodeSegments segments() const {
+        return COBSEncodeSegments(std::ranges::data(_base), std::ranges::size(_base));
+    }
+
+  private:
+    V _base = V();
+};
+
+/**
+ * @brief  Lazy view of the COBS decoded bytes of a contiguous range.
+ *         segments() gives run-wise access for algorithms which
+ *         can process whole runs at once.
+ */
+template <std::ranges::view V>
+    requires byte_range<V>
+class decode_view : public std::ranges::view_interface<decode_view<V>> {
+  public:
+    decode_view() = default;
+    explicit decode_view(V base) : _base(std::move(base)) {}
+
+    decode_iterator begin() const {
+        return decode_iterator(std::ranges::data(_base), std::ranges::size(_base));
+    }
+
+    std::default_sentinel_t end() const {
+        return std::default_sentinel;
+    }
+
+    COBSDecodeSegments segments() const {
+        return COBSDecodeSegments(std::ranges::data(_base), std::ranges::size(_base));
+    }
+
+  private:
+    V _base = V();
+};
+
+namespace views {
+
+// Range adaptor objects, usable as cobs::views::encode(r) or r | cobs::views::encode.
+template <template <class> class View>
+struct adaptor {
+    template <std::ranges::viewable_range R>
+        requires byte_range<std::views::all_t<R>>
+    auto operator()(R &&r) const {
+        return View<std::views::all_t<R>>(std::views::all(std::forward<R>(r)));
+    }
+
+    template <std::ranges::viewable_range R>
+        requires byte_range<std::views::all_t<R>>
+    friend auto operator|(R &&r, const adaptor &a) {
+        return a(std::forward<R>(r));
+    }
+};
+
+inline constexpr adaptor<encode_view> encode{};
+inline constexpr adaptor<decode_view> decode{};
+
+} // namespace views
+
+} // namespace cobs
+
+#endif